@@ -12,6 +12,8 @@ WITNESSES_BY_PROGRAM_HASH_DIR = "witnessListByProgramHashJSON"
 WITNESS_INFO_BY_WITNESS_HASH_DIR = "witnessInfoByHash"
 WITNESS_FILE_BY_HASH_DIR = "witnessFileByHash"
 SV_BENCHMARK_DIR = ""
+# NITWIT reads the witnesses compressed as well, so witnessFileByHash may be kept packed
+WITNESS_FILE_SUFFIXES = ['.graphml', '.graphml.gz', '.graphml.zst']
 
 
 def setup_dirs(dir: str, sv_dir: str) -> bool:
@@ -64,8 +66,7 @@ def get_bench_params(exec_limit: Union[int, None], should_include: Callable[[str
                                                                                      "sv-benchmarks/c/"):])
                             if 'witness-sha256' in jObj:
                                 # check if file in witnessFileByHash exists
-                                path_to_witness_file = \
-                                    os.path.join(WITNESS_FILE_BY_HASH_DIR, f'{jObj["witness-sha256"]}.graphml')
+                                path_to_witness_file = get_witness_file_path(jObj["witness-sha256"])
                                 if not os.path.isfile(path_to_witness_file):
                                     print(f"{path_to_witness_file} did not exist")
                                     continue
@@ -97,6 +98,14 @@ def get_result_set(path: str) -> Set[str]:
         return set([result[1] for result in jObj])
 
 
+def get_witness_file_path(witness_hash: str) -> str:
+    for suffix in WITNESS_FILE_SUFFIXES:
+        path = os.path.join(WITNESS_FILE_BY_HASH_DIR, f"{witness_hash}{suffix}")
+        if os.path.isfile(path):
+            return path
+    return os.path.join(WITNESS_FILE_BY_HASH_DIR, f"{witness_hash}.graphml")
+
+
 def get_benchmark_file_path(benchmark: str):
     b = os.path.join(SV_BENCHMARK_DIR, benchmark)
     if not os.path.isfile(b):
@@ -114,7 +123,7 @@ def extract_config_from_extracted_data(json_data: str, limit: int, should_includ
         raise Exception("Data file doesn't exist.")
     with open(json_data) as fp:
         witnesses = json.load(fp)['byWitnessHash']
-    result = [(os.path.join(WITNESS_FILE_BY_HASH_DIR, f"{w}.graphml"),
+    result = [(get_witness_file_path(w),
                get_benchmark_file_path(v['benchmark']),
                f"{w}.json",
                v['tool'])
@@ -1,13 +1,23 @@
+#include <cerrno>
+#include <csignal>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef UNIX_HOST
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "picoc/picoc.hpp"
 
 #undef min
 
 #include "utils/files.hpp"
-#include "witness/witness.hpp"
 #include "witness/automaton.hpp"
 
 std::shared_ptr<WitnessAutomaton> wit_aut;
@@ -79,22 +89,14 @@ void handleDebugBreakpoint(ParseState* ps, bool isMultiLineDeclaration, std::siz
 	}
 }
 
-int validate(const char *source_filename, const char *error_function_name, bool& error_function_was_called) {
-	error_function_was_called = false;
+// sets up the interpreter with the system headers. returns false with the exit value if that didn't work out
+bool prepareInterpreter(Picoc *pc, int& exit_value) {
+	PicocInitialise(pc, 104857600); // stack size of 100 MiB
+	pc->VerifierErrorFunctionWasCalled = false;
 
-	Picoc pc;
-	PicocInitialise(&pc, 104857600); // stack size of 100 MiB
-	pc.VerifierErrorFuncName = error_function_name;
-	pc.VerifierErrorFunctionWasCalled = false;
-
-	// the interpreter will jump here after finding a violation
-	if (PicocPlatformSetExitPoint(&pc)) {
-		cw_verbose("===============Finished=================\n");
-		cw_verbose("Stopping the interpreter.\n");
-		int ret = pc.PicocExitValue;
-		error_function_was_called = pc.VerifierErrorFunctionWasCalled;
-		PicocCleanup(&pc);
-		return ret;
+	if (PicocPlatformSetExitPoint(pc)) {
+		exit_value = pc->PicocExitValue;
+		return false;
 	}
 
 	cw_verbose("============Start simulation============\n");
@@ -102,47 +104,89 @@ int validate(const char *source_filename, const char *error_function_name, bool&
 	// like stdio, stdlib, special error, assume, nondet functions
 
 #ifndef NO_HEADER_INCLUDE
-	PicocIncludeAllSystemHeaders(&pc);
+	PicocIncludeAllSystemHeaders(pc);
 #endif
+	return true;
+}
+
+// loads and lexes the program into a prepared interpreter. returns false with the exit value if that didn't work out
+bool prepareProgram(Picoc *pc, const char *source_filename, const char *error_function_name, MappedFile& sourceFile, void *&tokens, int& exit_value) {
+	pc->VerifierErrorFuncName = nitwit::table::TableStrRegister(pc, error_function_name);
+
+	if (PicocPlatformSetExitPoint(pc)) {
+		exit_value = pc->PicocExitValue;
+		return false;
+	}
 
 	bool error = true;
-	std::string const sourceString = readFile(source_filename, error);
+	sourceFile = readFile(source_filename, error);
 	if (error) {
-		return 255;
+		exit_value = 255;
+		return false;
+	}
+
+	tokens = nitwit::parse::PicocLex(pc, source_filename, sourceFile.data(), static_cast<int>(sourceFile.size()), FALSE);
+	return true;
+}
+
+// what the program did with its heap, in verbose mode
+void printGuestHeapStats(Picoc *pc) {
+	cw_verbose("Program heap: %llu allocations, %llu frees, %llu bytes in use, at most %llu bytes of %llu.\n",
+			   pc->GuestHeapStats.Allocations, pc->GuestHeapStats.Frees, pc->GuestHeapStats.InUse,
+			   pc->GuestHeapStats.Peak, pc->GuestHeapLimit);
+}
+
+// runs the lexed program against wit_aut. the global declarations are parsed here as well, as their breakpoints
+// already move the witness automaton along
+int runProgram(Picoc *pc, const char *source_filename, MappedFile const& sourceFile, void *tokens, bool& error_function_was_called) {
+	// the interpreter will jump here after finding a violation
+	if (PicocPlatformSetExitPoint(pc)) {
+		cw_verbose("===============Finished=================\n");
+		cw_verbose("Stopping the interpreter.\n");
+		printGuestHeapStats(pc);
+		error_function_was_called = pc->VerifierErrorFunctionWasCalled;
+		return pc->PicocExitValue;
 	}
-	char* source = static_cast<char*>(malloc(sourceString.length() + 1));
-	strcpy(source, sourceString.c_str());
-	int const sourceLength = static_cast<int>(strlen(source));
 
-	nitwit::parse::PicocParse(&pc, source_filename, source, sourceLength, TRUE, FALSE, TRUE, TRUE, handleDebugBreakpoint);
+	nitwit::parse::PicocParseTokens(pc, source_filename, sourceFile.data(), tokens, TRUE, TRUE, handleDebugBreakpoint);
 
 	Value *MainFuncValue = nullptr;
-	VariableGet(&pc, nullptr, nitwit::table::TableStrRegister(&pc, "main"), &MainFuncValue);
+	VariableGet(pc, nullptr, nitwit::table::TableStrRegister(pc, "main"), &MainFuncValue);
 
 
 	if (MainFuncValue->Typ->Base != BaseType::TypeFunction) {
-		ProgramFailNoParser(&pc, "main is not a function - can't call it");
+		ProgramFailNoParser(pc, "main is not a function - can't call it");
 	}
 
-	PicocCallMain(&pc, nullptr, 0, nullptr);
+	PicocCallMain(pc, nullptr, 0, nullptr);
 	cw_verbose("===============Finished=================\n\n");
-	cw_verbose("Program finished. Exit value: %d\n", pc.PicocExitValue);
+	cw_verbose("Program finished. Exit value: %d\n", pc->PicocExitValue);
+	printGuestHeapStats(pc);
 
-	PicocCleanup(&pc);
 	return PROGRAM_FINISHED;
 }
 
-int main(int argc, char **argv) {
-	if (argc < 4) {
-		std::cout << "Usage: <nitwit> witness.graphml source-file.c errorFunctionName" << std::endl;
-		return 3;
+int validate(const char *source_filename, const char *error_function_name, bool& error_function_was_called) {
+	error_function_was_called = false;
+
+	Picoc pc;
+	MappedFile sourceFile; // outlives the interpreter, which keeps pointers into the source text
+	void *tokens = nullptr;
+	int exit_value = 0;
+	if (prepareInterpreter(&pc, exit_value) && prepareProgram(&pc, source_filename, error_function_name, sourceFile, tokens, exit_value)) {
+		exit_value = runProgram(&pc, source_filename, sourceFile, tokens, error_function_was_called);
 	}
 
-	auto doc = parseGraphmlWitness(argv[1]);
-	if (doc == nullptr) {
+	PicocCleanup(&pc);
+	return exit_value;
+}
+
+// reads the witness into wit_aut. returns 0, or the exit code if it can't be validated against
+int loadWitness(const char *witness_filename) {
+	wit_aut = WitnessAutomaton::automatonFromWitness(witness_filename);
+	if (wit_aut == nullptr) {
 		return 2;
 	}
-	wit_aut = WitnessAutomaton::automatonFromWitness(doc);
 
 	// check if witness automaton was successfully constructed
 	if (wit_aut && !wit_aut->isInIllegalState()) {
@@ -157,20 +201,22 @@ int main(int argc, char **argv) {
 		std::cout << "UNKNOWN: NITWIT expects a violation witness yet a different type was specified: " << wit_aut->getData().witness_type << "." << std::endl;
 		return RESULT_UNKNOWN;
 	}
+	return 0;
+}
 
-	bool errorFunctionWasCalled = false;
-	int exit_value = validate(argv[2], argv[3], errorFunctionWasCalled);
+// prints the verdict on wit_aut after the program ran and returns the final exit code
+int reportVerdict(int exit_value, bool& errorFunctionWasCalled, const char *error_function_name) {
 	errorFunctionWasCalled = errorFunctionWasCalled || wit_aut->wasVerifierErrorCalled();
 
 	std::cout << "Witness in violation state: " << (wit_aut->isInViolationState() ? "yes" : "no") << std::endl;
-	std::cout << "Error function \"" << argv[3] << "\" called during execution: " << (errorFunctionWasCalled ? "yes" : "no") << std::endl;
+	std::cout << "Error function \"" << error_function_name << "\" called during execution: " << (errorFunctionWasCalled ? "yes" : "no") << std::endl;
 	std::cout << "Unsuccessful witness automaton transitions: " << wit_aut->getUnsuccessfulTries() << " of at most " << UNSUCCESSFUL_TRIES_LIMIT << "." << std::endl;
 
 	// check whether we finished in a violation state and if __VERIFIER_error was called
 	if ((!wit_aut->isInViolationState() || !errorFunctionWasCalled) &&
 		(exit_value >= NO_WITNESS_CODE && exit_value <= ALREADY_DEFINED)) {
 		cw_verbose("WitnessAutomaton finished in state %s, with error code %d.\n",
-				   wit_aut->getCurrentState()->id.c_str(),
+				   wit_aut->getCurrentState().id.c_str(),
 				   exit_value);
 		std::cout << "FAILED: Wasn't able to validate the witness." << std::endl;
 
@@ -184,27 +230,29 @@ int main(int argc, char **argv) {
 
 		// check whether we finished in a state where __VERIFIER_error was called
 		if (errorFunctionWasCalled) {
-			std::cout << ", error function '" << argv[3] << "' was called.";
+			std::cout << ", error function '" << error_function_name << "' was called.";
 		} else {
-			std::cout << ", error function '" << argv[3] << "' was never called.";
+			std::cout << ", error function '" << error_function_name << "' was never called.";
 		}
 		std::cout << std::endl;
 	} else if (wit_aut->isInViolationState() && !errorFunctionWasCalled) {
-		std::cout << " #*# FAILED: The error function '" << argv[3] << "' was never called, even though the witness IS in a violation state." << std::endl;
+		std::cout << " #*# FAILED: The error function '" << error_function_name << "' was never called, even though the witness IS in a violation state." << std::endl;
 		exit_value = UNVALIDATED_VIOLATION;
 	} else if (errorFunctionWasCalled) {
 		std::cout << std::endl;
 		if (wit_aut->isInViolationState()) {
-			std::cout << "VALIDATED: The state '" << wit_aut->getCurrentState()->id << "' has been reached. The state is a violation state." << std::endl;
+			std::cout << "VALIDATED: The state '" << wit_aut->getCurrentState().id << "' has been reached. The state is a violation state." << std::endl;
 			exit_value = 0;
 		} else {
 #ifdef STRICT_VALIDATION
-			std::cout << "FAILED: The error function '" << argv[3] << "' was called and the state '" << wit_aut->getCurrentState()->id << "' has been reached. However, this state is NOT a violation state. (strict mode)" << std::endl;
+			std::cout << "FAILED: The error function '" << error_function_name << "' was called and the state '" << wit_aut->getCurrentState().id << "' has been reached. However, this state is NOT a violation state. (strict mode)" << std::endl;
 #else
-			std::cout << "VALIDATED: The error function '" << argv[3] << "' was called and the state '" << wit_aut->getCurrentState()->id << "' has been reached. However, this state is NOT a violation state. (non-strict mode)" << std::endl;
+			std::cout << "VALIDATED: The error function '" << error_function_name << "' was called and the state '" << wit_aut->getCurrentState().id << "' has been reached. However, this state is NOT a violation state. (non-strict mode)" << std::endl;
 #endif
 			exit_value = PROGRAM_FINISHED_WITH_VIOLATION_THOUGH_NOT_IN_VIOLATION_STATE;
 		}
+	} else if (exit_value == OUT_OF_MEMORY) {
+		std::cout << "UNKNOWN: The program ran out of memory." << std::endl;
 	} else {
 		std::cout <<  "UNKNOWN: An unhandled error/termination occurred, probably a parsing error or program exited. Program return code was " << exit_value << "." << std::endl;
 		exit_value = RESULT_UNKNOWN;
@@ -219,6 +267,330 @@ int main(int argc, char **argv) {
 	return exit_value;
 }
 
+#ifdef UNIX_HOST
+// what a validation in a forked copy of the process sends back
+struct ForkedResult {
+	int return_code;
+	bool witness_in_violation_state;
+	bool error_function_called;
+	std::size_t unsuccessful_transitions;
+};
+
+// validates the witness against the lexed program and prints the verdict
+ForkedResult validateWitness(Picoc *pc, const char *source_filename, const char *error_function_name,
+							 MappedFile const& sourceFile, void *tokens, const char *witness_filename) {
+	ForkedResult r{};
+	r.return_code = loadWitness(witness_filename);
+	if (r.return_code == 0) {
+		bool errorFunctionWasCalled = false;
+		int exit_value = runProgram(pc, source_filename, sourceFile, tokens, errorFunctionWasCalled);
+		r.return_code = reportVerdict(exit_value, errorFunctionWasCalled, error_function_name);
+		r.witness_in_violation_state = wit_aut->isInViolationState();
+		r.error_function_called = errorFunctionWasCalled;
+		r.unsuccessful_transitions = wit_aut->getUnsuccessfulTries();
+	}
+	return r;
+}
+
+// runs the validation in a forked copy of the process, so that it works on a fresh copy of the interpreter's globals
+// and heap. returns the signal the copy died of, or 0 if it finished
+template<typename Validation>
+int runForked(Validation validation, ForkedResult& result) {
+	int fds[2];
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		return SIGABRT;
+	}
+
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return SIGABRT;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		ForkedResult r = validation();
+		ssize_t written = write(fds[1], &r, sizeof(r));
+		std::cout.flush();
+		std::cerr.flush();
+		fflush(nullptr);
+		// the interpreter is thrown away with the process
+		_exit(written == sizeof(r) ? 0 : 1);
+	}
+
+	close(fds[1]);
+	result = ForkedResult{};
+	std::size_t got = 0;
+	while (got < sizeof(result)) {
+		ssize_t n = read(fds[0], reinterpret_cast<char *>(&result) + got, sizeof(result) - got);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		got += n;
+	}
+	close(fds[0]);
+
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	if (WIFSIGNALED(status)) {
+		return WTERMSIG(status);
+	}
+	if (got != sizeof(result)) {
+		return SIGABRT;
+	}
+	return 0;
+}
+
+void printJsonString(FILE *out, std::string const& str) {
+	fputc('"', out);
+	for (unsigned char c: str) {
+		if (c == '"' || c == '\\') {
+			fprintf(out, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(out, "\\u%04x", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+// prints the result of a forked validation as one line of JSON
+void printForkedResult(FILE *out, std::string const& witness_filename, const char *source_filename, int signal, ForkedResult const& result) {
+	fprintf(out, "{\"witness\": ");
+	printJsonString(out, witness_filename);
+	if (source_filename != nullptr) {
+		fprintf(out, ", \"program\": ");
+		printJsonString(out, source_filename);
+	}
+	if (signal != 0) {
+		fprintf(out, ", \"return_code\": %d, \"signal\": %d}\n", 128 + signal, signal);
+	} else {
+		fprintf(out, ", \"return_code\": %d, \"witness_in_violation_state\": %s, \"error_function_called\": %s, \"unsuccessful_transitions\": %zu}\n",
+				result.return_code,
+				result.witness_in_violation_state ? "true" : "false",
+				result.error_function_called ? "true" : "false",
+				result.unsuccessful_transitions);
+	}
+	fflush(out);
+}
+
+// keeps stdout for the results in the returned stream and sends everything else that's printed to stderr
+FILE *redirectOutputToStderr() {
+	std::cout.flush();
+	fflush(stdout);
+	FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+	if (results == nullptr || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		perror("redirecting output");
+		return nullptr;
+	}
+	return results;
+}
+
+// validates every witness against the program, which is loaded and lexed only once. stdout gets one JSON object per
+// witness and line, in order
+int validateBatch(const char *source_filename, const char *error_function_name, std::vector<std::string> const& witness_filenames) {
+	FILE *results = redirectOutputToStderr();
+	if (results == nullptr) {
+		return 3;
+	}
+
+	Picoc pc;
+	MappedFile sourceFile;
+	void *tokens = nullptr;
+	int exit_value = 0;
+	if (!prepareInterpreter(&pc, exit_value) || !prepareProgram(&pc, source_filename, error_function_name, sourceFile, tokens, exit_value)) {
+		PicocCleanup(&pc);
+		fclose(results);
+		return exit_value;
+	}
+
+	for (auto const& witness_filename : witness_filenames) {
+		ForkedResult result{};
+		int signal = runForked([&]() {
+			return validateWitness(&pc, source_filename, error_function_name, sourceFile, tokens, witness_filename.c_str());
+		}, result);
+		printForkedResult(results, witness_filename, nullptr, signal, result);
+	}
+
+	PicocCleanup(&pc);
+	fclose(results);
+	return 0;
+}
+
+// answers the requests on in, one per line as "witness.graphml<TAB>source-file.c<TAB>errorFunctionName", with one line
+// of JSON each on out. every request runs in its own fork of the prepared interpreter
+void serveRequests(Picoc *pc, FILE *in, FILE *out) {
+	char *line = nullptr;
+	std::size_t capacity = 0;
+	ssize_t length;
+	while ((length = getline(&line, &capacity, in)) >= 0) {
+		std::string request(line, length);
+		while (!request.empty() && (request.back() == '\n' || request.back() == '\r')) {
+			request.pop_back();
+		}
+		if (request.empty()) {
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		std::size_t start = 0, tab;
+		while ((tab = request.find('\t', start)) != std::string::npos) {
+			fields.push_back(request.substr(start, tab - start));
+			start = tab + 1;
+		}
+		fields.push_back(request.substr(start));
+
+		ForkedResult result{};
+		if (fields.size() != 3) {
+			std::cerr << "Malformed request, expected witness.graphml<TAB>source-file.c<TAB>errorFunctionName: " << request << std::endl;
+			result.return_code = 3;
+			printForkedResult(out, request, nullptr, 0, result);
+			continue;
+		}
+
+		int signal = runForked([&]() {
+			MappedFile sourceFile;
+			void *tokens = nullptr;
+			ForkedResult r{};
+			if (!prepareProgram(pc, fields[1].c_str(), fields[2].c_str(), sourceFile, tokens, r.return_code)) {
+				return r;
+			}
+			return validateWitness(pc, fields[1].c_str(), fields[2].c_str(), sourceFile, tokens, fields[0].c_str());
+		}, result);
+		printForkedResult(out, fields[0], fields[1].c_str(), signal, result);
+	}
+	free(line);
+}
+
+// sets up the interpreter with the system headers once and then serves validation requests from stdin, or from the
+// connections to a unix socket if a path is given. each connection is served by its own fork
+int runZygote(const char *socket_path) {
+	FILE *results = redirectOutputToStderr();
+	if (results == nullptr) {
+		return 3;
+	}
+
+	Picoc pc;
+	int exit_value = 0;
+	if (!prepareInterpreter(&pc, exit_value)) {
+		PicocCleanup(&pc);
+		fclose(results);
+		return exit_value;
+	}
+
+	if (socket_path == nullptr) {
+		serveRequests(&pc, stdin, results);
+		PicocCleanup(&pc);
+		fclose(results);
+		return 0;
+	}
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path too long: " << socket_path << std::endl;
+		return 3;
+	}
+	strcpy(address.sun_path, socket_path);
+	unlink(socket_path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		perror(socket_path);
+		return 3;
+	}
+	cw_verbose("Serving validation requests on %s\n", socket_path);
+
+	// the connection handlers are never waited for
+	signal(SIGCHLD, SIG_IGN);
+	while (true) {
+		int connection = accept(listener, nullptr, nullptr);
+		if (connection < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("accept");
+			break;
+		}
+
+		std::cout.flush();
+		std::cerr.flush();
+		fflush(nullptr);
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(listener);
+			signal(SIGCHLD, SIG_DFL);
+			FILE *in = fdopen(connection, "r");
+			FILE *out = fdopen(dup(connection), "w");
+			if (in != nullptr && out != nullptr) {
+				serveRequests(&pc, in, out);
+			}
+			fflush(nullptr);
+			_exit(0);
+		}
+		if (pid < 0) {
+			perror("fork");
+		}
+		close(connection);
+	}
+
+	close(listener);
+	unlink(socket_path);
+	PicocCleanup(&pc);
+	fclose(results);
+	return 3;
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifdef UNIX_HOST
+	if (argc >= 4 && strcmp(argv[1], "--batch") == 0) {
+		// the witnesses are the remaining arguments, or the lines of stdin if there are none
+		std::vector<std::string> witness_filenames(argv + 4, argv + argc);
+		if (witness_filenames.empty()) {
+			std::string line;
+			while (std::getline(std::cin, line)) {
+				if (!line.empty()) {
+					witness_filenames.push_back(line);
+				}
+			}
+		}
+		return validateBatch(argv[2], argv[3], witness_filenames);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--zygote") == 0) {
+		return runZygote(argc >= 3 ? argv[2] : nullptr);
+	}
+#endif
+	if (argc < 4) {
+		std::cout << "Usage: <nitwit> witness.graphml source-file.c errorFunctionName" << std::endl;
+#ifdef UNIX_HOST
+		std::cout << "       <nitwit> --batch source-file.c errorFunctionName [witness.graphml...]" << std::endl;
+		std::cout << "       <nitwit> --zygote [socket-path]" << std::endl;
+#endif
+		return 3;
+	}
+
+	int witness_code = loadWitness(argv[1]);
+	if (witness_code != 0) {
+		return witness_code;
+	}
+
+	bool errorFunctionWasCalled = false;
+	int exit_value = validate(argv[2], argv[3], errorFunctionWasCalled);
+	return reportVerdict(exit_value, errorFunctionWasCalled, argv[3]);
+}
+
 #ifdef UNIX_HOST
 #include <sys/resource.h>
 #elif defined(WIN32)
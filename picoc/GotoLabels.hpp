@@ -0,0 +1,36 @@
+#ifndef NITWIT_PICOC_GOTOLABELS_H_
+#define NITWIT_PICOC_GOTOLABELS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/* the braced blocks of a function body and the goto labels inside them, so that
+ * a goto search can step over every block that cannot contain its label */
+class GotoLabelIndex {
+public:
+    struct Block {
+        const unsigned char *Inner;     /* the token after the '{' */
+        const unsigned char *Close;     /* the matching '}' */
+        std::size_t CloseLine;          /* line number at the '}' */
+        bool Skippable;                 /* false if preprocessor directives are inside */
+    };
+
+    std::vector<Block> Blocks;                                              /* ordered by Inner */
+    std::vector<std::pair<const char *, const unsigned char *>> Labels;     /* label identifier and position, ordered */
+
+    Block const *findBlock(const unsigned char *Inner) const {
+        auto it = std::lower_bound(Blocks.begin(), Blocks.end(), Inner, [](Block const& b, const unsigned char *p) {
+            return b.Inner < p;
+        });
+        return (it != Blocks.end() && it->Inner == Inner) ? &*it : nullptr;
+    }
+
+    bool containsLabel(Block const& b, const char *Label) const {
+        auto it = std::lower_bound(Labels.begin(), Labels.end(), std::make_pair(Label, b.Inner));
+        return it != Labels.end() && it->first == Label && it->second < b.Close;
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef NITWIT_PICOC_LIBRARYIMAGE_H_
+#define NITWIT_PICOC_LIBRARYIMAGE_H_
+
+#include "interpreter.hpp"
+
+/* the library prototypes as they were parsed at build time by tools/library_image.cpp, so that LibraryAdd() can
+ * define them without lexing and parsing them again */
+
+/* a type is a root followed by the types derived from it, each one found or made with TypeGetMatching() */
+struct LibraryImageStep {
+    ValueType Picoc::*Root;         /* a base type of the interpreter, or nullptr for a struct, union or enum */
+    BaseType Base;                  /* the root's or derived type's base type */
+    int ArraySize;
+    const char *Identifier;         /* the name of a struct, union or enum */
+};
+
+struct LibraryImageType {
+    int FirstStep;                  /* in LibraryImageSteps */
+    int NumSteps;
+};
+
+struct LibraryImageFunction {
+    const char *Prototype;          /* must be the prototype in the library's function list to use the image */
+    const char *Identifier;
+    int ReturnType;                 /* in LibraryImageTypes */
+    int NumParams;
+    int VarArgs;
+    int FirstParam;                 /* in LibraryImageParamTypes and LibraryImageParamNames */
+    int Line;                       /* where the parser ended up after the prototype */
+    int CharacterPos;
+};
+
+struct LibraryImage {
+    const char *LibraryName;        /* nullptr at the end of LibraryImages */
+    const LibraryImageFunction *Functions;
+    int NumFunctions;
+};
+
+extern const LibraryImageStep LibraryImageSteps[];
+extern const LibraryImageType LibraryImageTypes[];
+extern const int LibraryImageNumTypes;
+extern const int LibraryImageParamTypes[];
+extern const char *const LibraryImageParamNames[];
+extern const LibraryImage LibraryImages[];
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef NITWIT_PICOC_SCOPES_H_
+#define NITWIT_PICOC_SCOPES_H_
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+/* numbers block scopes by the position of their '{', so a block gets the same id every time it's entered */
+class ScopeNumbering {
+public:
+    int get(const unsigned char *Pos) {
+        return ids.emplace(Pos, static_cast<int>(ids.size()) + 1).first->second;
+    }
+
+private:
+    std::unordered_map<const unsigned char *, int> ids;
+};
+
+/* the local table slots that have been given a value in each block scope of a stack frame. the slots are only
+ * valid for the size of the table they were recorded at, as growing the table moves its entries */
+class ScopeEntries {
+public:
+    explicit ScopeEntries(unsigned TableSize) : tableSize(TableSize) {}
+
+    unsigned recordedTableSize() const {
+        return tableSize;
+    }
+
+    void add(int ScopeID, unsigned Slot) {
+        auto& e = entries[ScopeID];
+        if (std::find(e.begin(), e.end(), Slot) == e.end())
+            e.push_back(Slot);
+    }
+
+    std::vector<unsigned> const *find(int ScopeID) const {
+        auto it = entries.find(ScopeID);
+        return it != entries.end() ? &it->second : nullptr;
+    }
+
+private:
+    unsigned tableSize;
+    std::unordered_map<int, std::vector<unsigned>> entries;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef NITWIT_PICOC_SWITCHTABLES_H_
+#define NITWIT_PICOC_SWITCHTABLES_H_
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/* case dispatch tables for the switch statements of a function body, each one built the first time its switch runs */
+class SwitchJumpTables {
+public:
+    struct Target {
+        const unsigned char *Pos;       /* the 'case' or 'default' token, or the closing '}' */
+        std::size_t Line;               /* line number at that token */
+    };
+
+    struct Table {
+        bool Usable;                    /* false if the switch has to search for its case statement by statement */
+        std::unordered_map<int, Target> Cases;
+        Target Default;                 /* Pos is nullptr if there's no default */
+        Target Close;
+    };
+
+    std::unordered_map<const unsigned char *, Table> Tables;   /* keyed by the position of the switch's '{' */
+
+    /* where the switch body starts running for a given condition */
+    static Target const& dispatch(Table const& t, int Condition) {
+        auto it = t.Cases.find(Condition);
+        if (it != t.Cases.end())
+            return it->second;
+
+        return t.Default.Pos != nullptr ? t.Default : t.Close;
+    }
+};
+
+#endif
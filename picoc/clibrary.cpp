@@ -3,6 +3,7 @@
  
 #include "picoc.hpp"
 #include "interpreter.hpp"
+#include "LibraryImage.hpp"
 
 
 /* endian-ness checking */
@@ -27,26 +28,254 @@ void LibraryInit(Picoc *pc)
     VariableDefinePlatformVar(pc, nullptr, "LITTLE_ENDIAN", &pc->IntType, (union AnyValue *)&LittleEndian, FALSE);
 }
 
-/* add a library */
-void LibraryAdd(Picoc *pc, struct Table *GlobalTable, const char *LibraryName, struct LibraryFunction *FuncList)
+#ifndef NO_LIBRARY_IMAGE
+/* the image of a library, if it was made from exactly these prototypes and the structs it refers to are known */
+static const LibraryImage *LibraryFindImage(Picoc *pc, const char *LibraryName, struct LibraryFunction *FuncList)
+{
+    const LibraryImage *Image = &LibraryImages[0];
+    while (Image->LibraryName != nullptr && strcmp(Image->LibraryName, LibraryName) != 0)
+        Image++;
+
+    if (Image->LibraryName == nullptr)
+        return nullptr;
+
+    for (int Count = 0; Count < Image->NumFunctions; Count++)
+    {
+        const LibraryImageFunction *Func = &Image->Functions[Count];
+        if (FuncList[Count].Prototype == nullptr || strcmp(FuncList[Count].Prototype, Func->Prototype) != 0)
+            return nullptr;
+
+        for (int Param = -1; Param < Func->NumParams; Param++)
+        {
+            const LibraryImageType *Type = &LibraryImageTypes[Param < 0 ? Func->ReturnType : LibraryImageParamTypes[Func->FirstParam + Param]];
+            const LibraryImageStep *Root = &LibraryImageSteps[Type->FirstStep];
+            if (Root->Root != nullptr)
+                continue;
+
+            /* the struct has to come from the library's setup, parsing the prototype would make an empty one */
+            const char *Identifier = nitwit::table::TableStrRegister(pc, Root->Identifier);
+            struct ValueType *Typ = pc->UberType.DerivedTypeList;
+            while (Typ != nullptr && (Typ->Base != Root->Base || Typ->Identifier != Identifier))
+                Typ = Typ->Next;
+
+            if (Typ == nullptr)
+                return nullptr;
+        }
+    }
+
+    return FuncList[Image->NumFunctions].Prototype == nullptr ? Image : nullptr;
+}
+
+/* get a type of the library image */
+static struct ValueType *LibraryImageGetType(struct ParseState *Parser, int TypeIndex)
+{
+    Picoc *pc = Parser->pc;
+    const LibraryImageType *Type = &LibraryImageTypes[TypeIndex];
+    const LibraryImageStep *Step = &LibraryImageSteps[Type->FirstStep];
+    struct ValueType *Typ;
+
+    if (Step->Root != nullptr)
+        Typ = &(pc->*(Step->Root));
+    else
+        Typ = TypeGetMatching(pc, Parser, &pc->UberType, Step->Base, Step->ArraySize, nitwit::table::TableStrRegister(pc, Step->Identifier), TRUE, nullptr);
+
+    for (int Count = 1; Count < Type->NumSteps; Count++)
+    {
+        Step++;
+        Typ = TypeGetMatching(pc, Parser, Typ, Step->Base, Step->ArraySize,
+                              Step->Identifier[0] == '\0' ? pc->StrEmpty : nitwit::table::TableStrRegister(pc, Step->Identifier), TRUE, nullptr);
+    }
+
+    return Typ;
+}
+
+/* define a library function from its image, the same as ParseFunctionDefinition() would for its prototype */
+static void LibraryDefineImageFunction(struct ParseState *Parser, const LibraryImageFunction *Func, const struct LibraryFunction *LibFunc,
+                                       std::vector<struct ValueType *> &Types)
+{
+    Picoc *pc = Parser->pc;
+    char *Identifier = nitwit::table::TableStrRegister(pc, Func->Identifier);
+    auto GetType = [&](int TypeIndex) {
+        if (Types[TypeIndex] == nullptr)
+            Types[TypeIndex] = LibraryImageGetType(Parser, TypeIndex);
+        return Types[TypeIndex];
+    };
+
+    Value *FuncValue = VariableAllocValueAndData(pc, Parser, sizeof(struct FuncDef) + sizeof(struct ValueType *) * Func->NumParams +
+                                                              sizeof(const char *) * Func->NumParams, FALSE, nullptr, TRUE, nullptr);
+    FuncValue->Typ = &pc->FunctionType;
+    FuncValue->Val->FuncDef.ReturnType = GetType(Func->ReturnType);
+    FuncValue->Val->FuncDef.NumParams = Func->NumParams;
+    FuncValue->Val->FuncDef.VarArgs = Func->VarArgs;
+    FuncValue->Val->FuncDef.ParamType = (struct ValueType **)((char *)FuncValue->Val + sizeof(struct FuncDef));
+    FuncValue->Val->FuncDef.ParamName = (char **)((char *)FuncValue->Val->FuncDef.ParamType + sizeof(struct ValueType *) * Func->NumParams);
+    for (int Param = 0; Param < Func->NumParams; Param++)
+    {
+        FuncValue->Val->FuncDef.ParamType[Param] = GetType(LibraryImageParamTypes[Func->FirstParam + Param]);
+        FuncValue->Val->FuncDef.ParamName[Param] = nitwit::table::TableStrRegister(pc, LibraryImageParamNames[Func->FirstParam + Param]);
+    }
+    FuncValue->Val->FuncDef.Intrinsic = LibFunc->Func;
+
+    if (!nitwit::table::TableSet(pc, &pc->GlobalTable, Identifier, FuncValue, (char *)Parser->FileName, Func->Line, Func->CharacterPos))
+        ProgramFail(Parser, "Function '%s' is already defined", Identifier);
+}
+#endif
+
+/* define a library function by parsing its prototype */
+static void LibraryDefinePrototype(Picoc *pc, const struct LibraryFunction *LibFunc)
 {
     struct ParseState Parser;
-    int Count;
     char *Identifier;
     struct ValueType *ReturnType;
-    Value *NewValue;
-    void *Tokens;
     char *IntrinsicName = nitwit::table::TableStrRegister(pc, "c library");
-    
+
+    void *Tokens = nitwit::lex::LexAnalyse(pc, IntrinsicName, LibFunc->Prototype, static_cast<int>(strlen((char *)LibFunc->Prototype)), nullptr);
+    nitwit::lex::LexInitParser(&Parser, pc, LibFunc->Prototype, Tokens, IntrinsicName, TRUE, FALSE, nullptr);
+    TypeParse(&Parser, &ReturnType, &Identifier, nullptr, nullptr, false);
+    Value *NewValue = nitwit::parse::ParseFunctionDefinition(&Parser, ReturnType, Identifier, false);
+    NewValue->Val->FuncDef.Intrinsic = LibFunc->Func;
+    HeapFreeMem(pc, Tokens);
+}
+
+/* whether a library function can be defined under a name: an earlier library function of the same name stays, a
+ * prototype of the program's is replaced */
+static int LibraryCanDefine(struct ParseState *Parser, const char *Identifier)
+{
+    Picoc *pc = Parser->pc;
+    Value *OldFuncValue;
+
+    if (nitwit::table::TableGet(&pc->GlobalTable, Identifier, &OldFuncValue, nullptr, nullptr, nullptr))
+    {
+        if (OldFuncValue->Val->FuncDef.Body.Pos != nullptr)
+            ProgramFail(Parser, "Function '%s' is already defined", Identifier);
+
+        if (OldFuncValue->Val->FuncDef.Intrinsic != nullptr)
+            return FALSE;
+
+        VariableFree(pc, nitwit::table::TableDelete(pc, &pc->GlobalTable, Identifier));
+    }
+
+    return TRUE;
+}
+
+#ifdef LAZY_LIBRARY
+/* the name of the function a prototype of the form "type name(...)" declares, or nullptr for any other form */
+static char *LibraryPrototypeName(Picoc *pc, const char *Prototype)
+{
+    const char *End = strchr(Prototype, '(');
+    if (End == nullptr)
+        return nullptr;
+
+    while (End > Prototype && isspace(End[-1]))
+        End--;
+
+    const char *Start = End;
+    while (Start > Prototype && (isalnum(Start[-1]) || Start[-1] == '_'))
+        Start--;
+
+    if (Start == End || Start == Prototype || isdigit(*Start))
+        return nullptr;
+
+    return nitwit::table::TableStrRegister(pc, Start, static_cast<unsigned>(End - Start));
+}
+
+/* put a stub for a library function into the global table, it's defined by LibraryBind() when it's first looked up */
+static void LibraryAddStub(struct ParseState *Parser, char *Identifier, const struct LibraryFunction *LibFunc, const LibraryImageFunction *Func)
+{
+    Picoc *pc = Parser->pc;
+
+    if (!LibraryCanDefine(Parser, Identifier))
+        return;
+
+    Value *Stub = VariableAllocValueAndData(pc, Parser, sizeof(struct FuncDef), FALSE, nullptr, TRUE, nullptr);
+    Stub->Typ = &pc->FunctionType;
+    Stub->Val->FuncDef.ReturnType = &pc->VoidType;
+    Stub->Val->FuncDef.Intrinsic = LibFunc->Func;
+    Stub->Val->FuncDef.LazyFunction = LibFunc;
+    Stub->Val->FuncDef.LazyImage = Func;
+
+    if (!nitwit::table::TableSet(pc, &pc->GlobalTable, Identifier, Stub, (char *)Parser->FileName, Parser->Line, Parser->CharacterPos))
+        ProgramFail(Parser, "Function '%s' is already defined", Identifier);
+}
+
+/* define a library function which only has a stub in the global table so far, and get its value */
+void LibraryBind(Picoc *pc, const char *Ident, Value **FuncValue)
+{
+    const struct LibraryFunction *LibFunc = (*FuncValue)->Val->FuncDef.LazyFunction;
+#ifndef NO_LIBRARY_IMAGE
+    const LibraryImageFunction *Func = (*FuncValue)->Val->FuncDef.LazyImage;
+#endif
+
+    VariableFree(pc, nitwit::table::TableDelete(pc, &pc->GlobalTable, Ident));
+
+#ifndef NO_LIBRARY_IMAGE
+    if (Func != nullptr)
+    {
+        struct ParseState Parser;
+        std::vector<struct ValueType *> Types(LibraryImageNumTypes, nullptr);
+
+        nitwit::lex::LexInitParser(&Parser, pc, Func->Prototype, nullptr, nitwit::table::TableStrRegister(pc, "c library"), TRUE, FALSE, nullptr);
+        LibraryDefineImageFunction(&Parser, Func, LibFunc, Types);
+    }
+    else
+#endif
+    {
+        /* the prototype is parsed at the top level, wherever the function is first used */
+        struct StackFrame *TopStackFrame = pc->TopStackFrame;
+        pc->TopStackFrame = nullptr;
+        LibraryDefinePrototype(pc, LibFunc);
+        pc->TopStackFrame = TopStackFrame;
+    }
+
+    nitwit::table::TableGet(&pc->GlobalTable, Ident, FuncValue, nullptr, nullptr, nullptr);
+}
+#endif
+
+/* add a library */
+void LibraryAdd(Picoc *pc, struct Table *GlobalTable, const char *LibraryName, struct LibraryFunction *FuncList)
+{
+    struct ParseState Parser;
+    char *IntrinsicName = nitwit::table::TableStrRegister(pc, "c library");
+    const LibraryImageFunction *Funcs = nullptr;
+#ifndef NO_LIBRARY_IMAGE
+    const LibraryImage *Image = LibraryFindImage(pc, LibraryName, FuncList);
+    std::vector<struct ValueType *> Types(LibraryImageNumTypes, nullptr);
+    if (Image != nullptr)
+        Funcs = Image->Functions;
+#endif
+
+    nitwit::lex::LexInitParser(&Parser, pc, nullptr, nullptr, IntrinsicName, TRUE, FALSE, nullptr);
+
     /* read all the library definitions */
-    for (Count = 0; FuncList[Count].Prototype != nullptr; Count++)
+    for (int Count = 0; FuncList[Count].Prototype != nullptr; Count++)
     {
-        Tokens = nitwit::lex::LexAnalyse(pc, IntrinsicName, FuncList[Count].Prototype, static_cast<int>(strlen((char *)FuncList[Count].Prototype)), nullptr);
-        nitwit::lex::LexInitParser(&Parser, pc, FuncList[Count].Prototype, Tokens, IntrinsicName, TRUE, FALSE, nullptr);
-        TypeParse(&Parser, &ReturnType, &Identifier, nullptr, nullptr, false);
-        NewValue = nitwit::parse::ParseFunctionDefinition(&Parser, ReturnType, Identifier, false);
-        NewValue->Val->FuncDef.Intrinsic = FuncList[Count].Func;
-        HeapFreeMem(pc, Tokens);
+        const LibraryImageFunction *Func = Funcs != nullptr ? &Funcs[Count] : nullptr;
+        Parser.SourceText = FuncList[Count].Prototype;
+        if (Func != nullptr)
+        {
+            Parser.Line = Func->Line;
+            Parser.CharacterPos = Func->CharacterPos;
+        }
+
+#ifdef LAZY_LIBRARY
+        char *Identifier = Func != nullptr ? nitwit::table::TableStrRegister(pc, Func->Identifier) : LibraryPrototypeName(pc, FuncList[Count].Prototype);
+        if (Identifier != nullptr)
+        {
+            LibraryAddStub(&Parser, Identifier, &FuncList[Count], Func);
+            continue;
+        }
+#endif
+
+#ifndef NO_LIBRARY_IMAGE
+        if (Func != nullptr)
+        {
+            if (LibraryCanDefine(&Parser, nitwit::table::TableStrRegister(pc, Func->Identifier)))
+                LibraryDefineImageFunction(&Parser, Func, &FuncList[Count], Types);
+            continue;
+        }
+#endif
+
+        LibraryDefinePrototype(pc, &FuncList[Count]);
     }
 }
 
@@ -460,26 +689,26 @@ void LibFloor(struct ParseState *Parser, Value *ReturnValue, Value **Param, int
 #ifndef NO_STRING_FUNCTIONS
 void LibMalloc(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = malloc(Param[0]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapAllocGuest(Parser, (unsigned int)Param[0]->Val->Integer);
 }
 
 #ifndef NO_CALLOC
 void LibCalloc(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = calloc(Param[0]->Val->Integer, Param[1]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapAllocGuest(Parser, (unsigned long long)(unsigned int)Param[0]->Val->Integer * (unsigned int)Param[1]->Val->Integer);
 }
 #endif
 
 #ifndef NO_REALLOC
 void LibRealloc(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = realloc(Param[0]->Val->Pointer, Param[1]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapReallocGuest(Parser, Param[0]->Val->Pointer, (unsigned int)Param[1]->Val->Integer);
 }
 #endif
 
 void LibFree(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    free(Param[0]->Val->Pointer);
+    HeapFreeGuest(Parser->pc, Param[0]->Val->Pointer);
 }
 
 void LibStrcpy(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
@@ -37,22 +37,22 @@ void StdlibStrtoul(struct ParseState *Parser, Value *ReturnValue, Value **Param,
 
 void StdlibMalloc(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = calloc(Param[0]->Val->Integer, 1);
+    ReturnValue->Val->Pointer = HeapAllocGuest(Parser, (unsigned int)Param[0]->Val->Integer);
 }
 
 void StdlibCalloc(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = calloc(Param[0]->Val->Integer, Param[1]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapAllocGuest(Parser, (unsigned long long)(unsigned int)Param[0]->Val->Integer * (unsigned int)Param[1]->Val->Integer);
 }
 
 void StdlibRealloc(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = realloc(Param[0]->Val->Pointer, Param[1]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapReallocGuest(Parser, Param[0]->Val->Pointer, (unsigned int)Param[1]->Val->Integer);
 }
 
 void StdlibFree(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    free(Param[0]->Val->Pointer);
+    HeapFreeGuest(Parser->pc, Param[0]->Val->Pointer);
 }
 
 void StdlibRand(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
@@ -132,7 +132,11 @@ void StringStrxfrm(struct ParseState *Parser, Value *ReturnValue, Value **Param,
 #ifndef WIN32
 void StringStrdup(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = strdup((const char*)Param[0]->Val->Pointer);
+    const char *Str = (const char*)Param[0]->Val->Pointer;
+    size_t Size = strlen(Str) + 1;
+
+    /* on the program's heap, so that it can free() it */
+    ReturnValue->Val->Pointer = memcpy(HeapAllocGuest(Parser, Size), Str, Size);
 }
 
 void StringStrtok_r(struct ParseState *Parser, Value *ReturnValue, Value **Param, int NumArgs)
@@ -1,110 +1,81 @@
-/* picoc interactive debugger */
-
-#ifndef NO_DEBUGGER
-
-#include "interpreter.hpp"
-
-#define BREAKPOINT_HASH(p) ( ((unsigned long)(p)->FileName) ^ (((p)->Line << 16) | ((p)->CharacterPos << 16)) )
-
-/* initialise the debugger by clearing the breakpoint table */
-void DebugInit(Picoc *pc)
-{
-    nitwit::table::TableInitTable(&pc->BreakpointTable, &pc->BreakpointHashTable[0], BREAKPOINT_TABLE_SIZE, true);
-    pc->BreakpointCount = 0;
-}
-
-/* free the contents of the breakpoint table */
-void DebugCleanup(Picoc *pc)
-{
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    int Count;
-    
-    for (Count = 0; Count < pc->BreakpointTable.Size; Count++)
-    {
-        for (Entry = pc->BreakpointHashTable[Count]; Entry != nullptr; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            HeapFreeMem(pc, Entry);
-        }
-    }
-}
-
-/* search the table for a breakpoint */
-static struct TableEntry *DebugTableSearchBreakpoint(struct ParseState *Parser, int *AddAt)
-{
-    struct TableEntry *Entry;
-    Picoc *pc = Parser->pc;
-    int HashValue = BREAKPOINT_HASH(Parser) % pc->BreakpointTable.Size;
-    
-    for (Entry = pc->BreakpointHashTable[HashValue]; Entry != nullptr; Entry = Entry->Next)
-    {
-        if (Entry->p.b.FileName == Parser->FileName && Entry->p.b.Line == Parser->Line && Entry->p.b.CharacterPos == Parser->CharacterPos)
-            return Entry;   /* found */
-    }
-    
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return nullptr;
-}
-
-/* set a breakpoint in the table */
-void DebugSetBreakpoint(struct ParseState *Parser)
-{
-    int AddAt;
-    struct TableEntry *FoundEntry = DebugTableSearchBreakpoint(Parser, &AddAt);
-    Picoc *pc = Parser->pc;
-    
-    if (FoundEntry == nullptr)
-    {   
-        /* add it to the table */
-        auto *NewEntry = static_cast<TableEntry *>(HeapAllocMem(pc, sizeof(struct TableEntry)));
-        if (NewEntry == nullptr) {
-            ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
-            return;
-        }
-            
-        NewEntry->p.b.FileName = Parser->FileName;
-        NewEntry->p.b.Line = Parser->Line;
-        NewEntry->p.b.CharacterPos = Parser->CharacterPos;
-        NewEntry->Next = pc->BreakpointHashTable[AddAt];
-        pc->BreakpointHashTable[AddAt] = NewEntry;
-        pc->BreakpointCount++;
-    }
-}
-
-/* delete a breakpoint from the hash table */
-int DebugClearBreakpoint(struct ParseState *Parser)
-{
-    struct TableEntry **EntryPtr;
-    Picoc *pc = Parser->pc;
-    int HashValue = BREAKPOINT_HASH(Parser) % pc->BreakpointTable.Size;
-    
-    for (EntryPtr = &pc->BreakpointHashTable[HashValue]; *EntryPtr != nullptr; EntryPtr = &(*EntryPtr)->Next)
-    {
-        struct TableEntry *DeleteEntry = *EntryPtr;
-        if (DeleteEntry->p.b.FileName == Parser->FileName && DeleteEntry->p.b.Line == Parser->Line && DeleteEntry->p.b.CharacterPos == Parser->CharacterPos)
-        {
-            *EntryPtr = DeleteEntry->Next;
-            HeapFreeMem(pc, DeleteEntry);
-            pc->BreakpointCount--;
-
-            return TRUE;
-        }
-    }
-
-    return FALSE;
-}
-
-/* before we run a statement, check if there's anything we have to do with the debugger here */
-void DebugCheckStatement(struct ParseState *Parser, bool wasMultiLineDeclaration, std::size_t const& lastLine)
-{
-    if (Parser->DebuggerCallback != nullptr)
-    {
-        Parser->DebuggerCallback(Parser, wasMultiLineDeclaration, lastLine);
-    }
-}
-
-void DebugStep()
-{
-}
-#endif /* !NO_DEBUGGER */
+/* picoc interactive debugger */
+
+#ifndef NO_DEBUGGER
+
+#include "interpreter.hpp"
+
+#define BREAKPOINT_HASH(p) ( ((unsigned long)(p)->FileName) ^ (((p)->Line << 16) | ((p)->CharacterPos << 16)) )
+
+/* initialise the debugger by clearing the breakpoint table */
+void DebugInit(Picoc *pc)
+{
+    nitwit::table::TableInitTable(pc, &pc->BreakpointTable, nullptr, BREAKPOINT_TABLE_SIZE);
+    pc->BreakpointCount = 0;
+}
+
+/* free the contents of the breakpoint table */
+void DebugCleanup(Picoc *pc)
+{
+    nitwit::table::TableFree(pc, &pc->BreakpointTable);
+}
+
+static int DebugBreakpointMatches(const struct TableEntry *Entry, const void *Key)
+{
+    auto *Parser = static_cast<const struct ParseState *>(Key);
+    return Entry->p.b.FileName == Parser->FileName && Entry->p.b.Line == Parser->Line && Entry->p.b.CharacterPos == Parser->CharacterPos;
+}
+
+/* search the table for a breakpoint */
+static struct TableEntry *DebugTableSearchBreakpoint(struct ParseState *Parser, unsigned *AddAt)
+{
+    return nitwit::table::TableSearchHash(&Parser->pc->BreakpointTable, nitwit::table::TableEntryHash(BREAKPOINT_HASH(Parser)),
+                                          &DebugBreakpointMatches, Parser, AddAt);
+}
+
+/* set a breakpoint in the table */
+void DebugSetBreakpoint(struct ParseState *Parser)
+{
+    unsigned AddAt;
+    struct TableEntry *FoundEntry = DebugTableSearchBreakpoint(Parser, &AddAt);
+    Picoc *pc = Parser->pc;
+    
+    if (FoundEntry == nullptr)
+    {   
+        /* add it to the table */
+        struct TableEntry *NewEntry = nitwit::table::TableAdd(pc, &pc->BreakpointTable, nitwit::table::TableEntryHash(BREAKPOINT_HASH(Parser)), AddAt);
+        NewEntry->p.b.FileName = Parser->FileName;
+        NewEntry->p.b.Line = Parser->Line;
+        NewEntry->p.b.CharacterPos = Parser->CharacterPos;
+        pc->BreakpointCount++;
+    }
+}
+
+/* delete a breakpoint from the hash table */
+int DebugClearBreakpoint(struct ParseState *Parser)
+{
+    unsigned AddAt;
+    struct TableEntry *FoundEntry = DebugTableSearchBreakpoint(Parser, &AddAt);
+    Picoc *pc = Parser->pc;
+
+    if (FoundEntry == nullptr)
+        return FALSE;
+
+    nitwit::table::TableRemove(&pc->BreakpointTable, FoundEntry);
+    pc->BreakpointCount--;
+
+    return TRUE;
+}
+
+/* before we run a statement, check if there's anything we have to do with the debugger here */
+void DebugCheckStatement(struct ParseState *Parser, bool wasMultiLineDeclaration, std::size_t const& lastLine)
+{
+    if (Parser->DebuggerCallback != nullptr)
+    {
+        Parser->DebuggerCallback(Parser, wasMultiLineDeclaration, lastLine);
+    }
+}
+
+void DebugStep()
+{
+}
+#endif /* !NO_DEBUGGER */
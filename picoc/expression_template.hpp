@@ -164,9 +164,8 @@ int IsTypeToken(struct ParseState *Parser, enum LexToken t, Value *LexValue)
     if (t == TokenIdentifier) /* see TypeParseFront, case TokenIdentifier and ParseTypedef */
     {
         Value * VarValue;
-        if (VariableDefined(Parser->pc, (const char*) LexValue->Val->Pointer))
+        if (VariableLookup(Parser->pc, (const char*) LexValue->Val->Pointer, &VarValue))
         {
-            VariableGet(Parser->pc, Parser, (const char*) LexValue->Val->Pointer, &VarValue);
             if (VarValue->Typ->Base == BaseType::Type_Type)
                 return 1;
         }
@@ -1696,10 +1695,10 @@ int ExpressionParse(struct ParseState *Parser, Value **Result)
 
     do
     {
-        ParseState PreState;
+        ParseCursor PreState;
         LexToken Token;
 
-        nitwit::parse::ParserCopy(&PreState, Parser);
+        nitwit::parse::ParserCopyPos(&PreState, Parser);
         Token = nitwit::lex::LexGetToken(Parser, &LexValue, true);
         debugf(EXPR_TEMPLATE_STRING_PREFIX "Looking at token %s.\n", tokenToString(Token));
 #ifdef EXPR_TEMPLATE_VIA_ASSUMPTIONS
@@ -1803,7 +1802,7 @@ int ExpressionParse(struct ParseState *Parser, Value **Result)
                             if (BracketPrecedence == 0)
                             {
                                 /* assume this bracket is after the end of the expression */
-                                nitwit::parse::ParserCopy(Parser, &PreState);
+                                nitwit::parse::ParserCopyPos(Parser, &PreState);
                                 Done = TRUE;
                             }
                             else
@@ -1916,7 +1915,7 @@ int ExpressionParse(struct ParseState *Parser, Value **Result)
                 if (RunIt){
                     VariableGet(Parser->pc, Parser, FuncName, &FuncValue);
                     if (FuncValue->Val->FuncDef.Intrinsic != nullptr
-                            && FuncName != nitwit::table::TableStrRegister(Parser->pc, "__VERIFIER_assume")){
+                            && FuncName != Parser->pc->StrVerifierAssume){
                         Parser->SkipIntrinsic = TRUE;
                     }
                 }
@@ -2024,7 +2023,7 @@ int ExpressionParse(struct ParseState *Parser, Value **Result)
                 ProgramFail(Parser, "type not expected here");
 
             PrefixState = FALSE;
-            nitwit::parse::ParserCopy(Parser, &PreState);
+            nitwit::parse::ParserCopyPos(Parser, &PreState);
             TypeParse(Parser, &Typ, &Identifier, nullptr, nullptr, 0);
             TypeValue = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->TypeType, FALSE, nullptr, FALSE);
             TypeValue->Val->Typ = Typ;
@@ -2034,7 +2033,7 @@ int ExpressionParse(struct ParseState *Parser, Value **Result)
             // sub-block expression with bracket precedence
             debugf(EXPR_TEMPLATE_STRING_PREFIX "it's a sub-block expression with bracket precedence\n");
 
-            struct ParseState OldParser = *(Parser);
+            struct ParseCursor OldParser;
             enum LexToken subToken = Token;
 
             Value *subResult;
@@ -2042,18 +2041,18 @@ int ExpressionParse(struct ParseState *Parser, Value **Result)
             // parse the complete subblock
             do {
                 EXPR_TEMPLATE_PREFIX ExpressionParse(Parser, &(subResult));
-                OldParser = *(Parser);
+                nitwit::parse::ParserCopyPos(&OldParser, Parser);
                 subToken = nitwit::lex::LexGetToken(Parser, &LexValue, true);
             } while((int)subToken != TokenRightBrace);
 
-            *(Parser) = OldParser;
+            nitwit::parse::ParserCopyPos(Parser, &OldParser);
         }
         else
         {
             /* it isn't a token from an expression */
             debugf(EXPR_TEMPLATE_STRING_PREFIX "it isn't a token from an expression\n");
 
-            nitwit::parse::ParserCopy(Parser, &PreState);
+            nitwit::parse::ParserCopyPos(Parser, &PreState);
             Done = TRUE;
         }
 
@@ -2269,7 +2268,7 @@ void ExpressionParseFunctionCall(struct ParseState *Parser, struct ExpressionSta
 
 #ifndef EXPR_TEMPLATE_VIA_ASSUMPTIONS
 		// We are entering a function, this might be a function hooked as the "error" function
-		if ((Parser->pc->VerifierErrorFuncName != nullptr) && (strcmp(FuncName, Parser->pc->VerifierErrorFuncName) == 0)) {
+		if (FuncName == Parser->pc->VerifierErrorFuncName) {
 			printf("Detected call to marked error function \"%s\"!\n", Parser->pc->VerifierErrorFuncName);
 			Parser->pc->VerifierErrorFunctionWasCalled = true;
 		}
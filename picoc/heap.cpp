@@ -1,16 +1,145 @@
-/* picoc heap memory allocation. Uses your system's own malloc() allocator */
+/* picoc heap memory allocation. the small blocks come from chunks of memory taken from your system's own malloc()
+ * allocator, the big ones directly from malloc() */
  
 /* stack grows up from the bottom and heap grows down from the top of heap space */
 #include "interpreter.hpp"
+#include <limits.h>
+
+#define HEAP_HEADER_SIZE MEM_ALIGN(sizeof(unsigned int))                    /* the size in front of every block */
+#define HEAP_BUCKET_LARGEST (FREELIST_BUCKETS * sizeof(ALIGN_TYPE))        /* the largest block which has a bucket */
+
+/* a chunk the small blocks are bumped off */
+struct HeapChunk
+{
+    struct HeapChunk *Next;
+};
+
+/* the links in front of a big block's header, so that its arena can be released */
+struct HeapBigNode
+{
+    struct HeapBigNode *Prev;
+    struct HeapBigNode *Next;
+};
+
+#define HEAP_BIG_NODE_SIZE MEM_ALIGN(sizeof(struct HeapBigNode))
+
+/* allocate a cleared block from an arena. can return nullptr if out of memory */
+static void *HeapArenaAlloc(struct HeapArena *Arena, int Size) {
+    unsigned int DataSize = Size > 0 ? MEM_ALIGN(Size) : sizeof(ALIGN_TYPE);
+    struct AllocNode *NewMem;
+
+    if (DataSize <= HEAP_BUCKET_LARGEST) {
+        /* a small block - reuse a freed one of the same size or bump it off the newest chunk */
+        int Bucket = DataSize / sizeof(ALIGN_TYPE) - 1;
+        unsigned int AllocSize = HEAP_HEADER_SIZE + DataSize;
+
+        NewMem = Arena->FreeListBucket[Bucket];
+        if (NewMem != nullptr) {
+            Arena->FreeListBucket[Bucket] = NewMem->NextFree;
+            memset((char *)NewMem + HEAP_HEADER_SIZE, '\0', DataSize);
+        } else {
+            if (Arena->ChunkTop == nullptr || Arena->ChunkEnd - Arena->ChunkTop < (long)AllocSize) {
+                /* the chunks come cleared so the blocks bumped off them don't need to be */
+                auto *Chunk = static_cast<struct HeapChunk *>(calloc(HEAP_CHUNK_SIZE, 1));
+                if (Chunk == nullptr)
+                    return nullptr;
+
+                Chunk->Next = Arena->Chunks;
+                Arena->Chunks = Chunk;
+                Arena->ChunkTop = (char *)Chunk + MEM_ALIGN(sizeof(struct HeapChunk));
+                Arena->ChunkEnd = (char *)Chunk + HEAP_CHUNK_SIZE;
+            }
+
+            NewMem = (struct AllocNode *)Arena->ChunkTop;
+            Arena->ChunkTop += AllocSize;
+        }
+
+        NewMem->Size = AllocSize;
+    } else {
+        /* a big block of its own, linked in so that it's released with the arena */
+        auto *Big = static_cast<struct HeapBigNode *>(calloc(HEAP_BIG_NODE_SIZE + HEAP_HEADER_SIZE + DataSize, 1));
+        if (Big == nullptr)
+            return nullptr;
+
+        Big->Next = Arena->BigList;
+        if (Arena->BigList != nullptr)
+            Arena->BigList->Prev = Big;
+        Arena->BigList = Big;
+
+        NewMem = (struct AllocNode *)((char *)Big + HEAP_BIG_NODE_SIZE);
+        NewMem->Size = HEAP_HEADER_SIZE + DataSize;
+    }
+
+#ifdef DEBUG_HEAP
+    printf("HeapArenaAlloc(%d) at %p\n", Size, (void*)((char *)NewMem + HEAP_HEADER_SIZE));
+#endif
+    return (char *)NewMem + HEAP_HEADER_SIZE;
+}
+
+/* give a block back to its arena */
+static void HeapArenaFree(struct HeapArena *Arena, void *Mem) {
+    struct AllocNode *MemNode;
+
+    if (Mem == nullptr)
+        return;
+
+    MemNode = (struct AllocNode *)((char *)Mem - HEAP_HEADER_SIZE);
+#ifdef DEBUG_HEAP
+    printf("HeapArenaFree(%p) of %d bytes\n", Mem, MemNode->Size);
+#endif
+    if (MemNode->Size <= HEAP_HEADER_SIZE + HEAP_BUCKET_LARGEST) {
+        int Bucket = (MemNode->Size - HEAP_HEADER_SIZE) / sizeof(ALIGN_TYPE) - 1;
+
+        MemNode->NextFree = Arena->FreeListBucket[Bucket];
+        Arena->FreeListBucket[Bucket] = MemNode;
+    } else {
+        auto *Big = (struct HeapBigNode *)((char *)MemNode - HEAP_BIG_NODE_SIZE);
+
+        if (Big->Prev != nullptr)
+            Big->Prev->Next = Big->Next;
+        else
+            Arena->BigList = Big->Next;
+
+        if (Big->Next != nullptr)
+            Big->Next->Prev = Big->Prev;
+
+        free(Big);
+    }
+}
+
+/* release all the chunks and big blocks of an arena at once */
+static void HeapArenaRelease(struct HeapArena *Arena) {
+    struct HeapChunk *Chunk;
+    struct HeapChunk *NextChunk;
+    struct HeapBigNode *Big;
+    struct HeapBigNode *NextBig;
+
+    for (Chunk = Arena->Chunks; Chunk != nullptr; Chunk = NextChunk) {
+        NextChunk = Chunk->Next;
+        free(Chunk);
+    }
+
+    for (Big = Arena->BigList; Big != nullptr; Big = NextBig) {
+        NextBig = Big->Next;
+        free(Big);
+    }
+
+    memset((void *)Arena, '\0', sizeof(*Arena));
+}
+
+/* the usable size of a block */
+static unsigned int HeapBlockSize(void *Mem) {
+    return ((struct AllocNode *)((char *)Mem - HEAP_HEADER_SIZE))->Size - HEAP_HEADER_SIZE;
+}
 
 #ifdef DEBUG_HEAP
 void ShowBigList(Picoc *pc)
 {
-    struct AllocNode *LPos;
+    struct HeapBigNode *LPos;
     
-    printf("Heap: bottom=%p %p-0x%lx, big freelist=", (void*)pc->HeapBottom, (void*)&(pc->HeapMemory)[0], (long)-1);
-    for (LPos = pc->FreeListBig; LPos != nullptr; LPos = LPos->NextFree)
-        printf("0x%lx:%d ", (long)LPos, LPos->Size);
+    printf("Heap: bottom=%p %p-0x%lx, big blocks=", (void*)pc->HeapBottom, (void*)&(pc->HeapMemory)[0], (long)-1);
+    for (LPos = pc->InterpreterHeap.BigList; LPos != nullptr; LPos = LPos->Next)
+        printf("0x%lx:%d ", (long)LPos, ((struct AllocNode *)((char *)LPos + HEAP_BIG_NODE_SIZE))->Size);
     
     printf("\n");
 }
@@ -18,7 +147,6 @@ void ShowBigList(Picoc *pc)
 
 /* initialise the stack and heap storage */
 void HeapInit(Picoc* pc, int StackOrHeapSize) {
-    int Count;
     int AlignOffset = 0;
     
     pc->HeapMemory = static_cast<unsigned char *>(malloc(StackOrHeapSize));
@@ -38,13 +166,55 @@ void HeapInit(Picoc* pc, int StackOrHeapSize) {
     pc->HeapStackTop = &(pc->HeapMemory)[AlignOffset];
     *(void **)(pc->StackFrame) = nullptr;
     pc->HeapBottom = &(pc->HeapMemory)[StackOrHeapSize-sizeof(ALIGN_TYPE)+AlignOffset];
-    pc->FreeListBig = nullptr;
-    for (Count = 0; Count < FREELIST_BUCKETS; Count++)
-        pc->FreeListBucket[Count] = nullptr;
+    memset((void *)&pc->InterpreterHeap, '\0', sizeof(pc->InterpreterHeap));
+    memset((void *)&pc->GuestHeap, '\0', sizeof(pc->GuestHeap));
+    memset((void *)&pc->GuestHeapStats, '\0', sizeof(pc->GuestHeapStats));
+    pc->GuestHeapLimit = GUEST_HEAP_LIMIT;
 }
 
+/* release the stack and everything allocated with HeapAllocMem() or by the program which is still around */
 void HeapCleanup(Picoc *pc) {
+    HeapArenaRelease(&pc->InterpreterHeap);
+    HeapArenaRelease(&pc->GuestHeap);
     free(pc->HeapMemory);
+    free(pc->AssumptionStackMemory);
+    pc->AssumptionStackMemory = nullptr;
+}
+
+/* park the program's stack and switch to an empty assumption stack. the scratch memory
+ * is allocated on first use and afterwards only rewound, so an evaluation costs no allocation */
+void HeapEnterAssumptionStack(Picoc *pc) {
+    int AlignOffset = 0;
+
+    if (pc->AssumptionStackMemory == nullptr) {
+        pc->AssumptionStackMemory = static_cast<unsigned char *>(malloc(ASSUMPTION_STACK_SIZE));
+        if (pc->AssumptionStackMemory == nullptr) {
+            std::cerr << "Failed to allocate " << ASSUMPTION_STACK_SIZE << " bytes of assumption stack memory." << std::endl;
+            throw;
+        }
+    }
+
+    pc->SavedHeapMemory = pc->HeapMemory;
+    pc->SavedHeapBottom = pc->HeapBottom;
+    pc->SavedStackFrame = pc->StackFrame;
+    pc->SavedHeapStackTop = pc->HeapStackTop;
+
+    while (((unsigned long)&pc->AssumptionStackMemory[AlignOffset] & (sizeof(ALIGN_TYPE)-1)) != 0)
+        AlignOffset++;
+
+    pc->HeapMemory = pc->AssumptionStackMemory;
+    pc->StackFrame = &(pc->HeapMemory)[AlignOffset];
+    pc->HeapStackTop = &(pc->HeapMemory)[AlignOffset];
+    *(void **)(pc->StackFrame) = nullptr;
+    pc->HeapBottom = &(pc->HeapMemory)[ASSUMPTION_STACK_SIZE-sizeof(ALIGN_TYPE)];
+}
+
+/* drop everything left on the assumption stack and go back to the program's stack */
+void HeapLeaveAssumptionStack(Picoc *pc) {
+    pc->HeapMemory = pc->SavedHeapMemory;
+    pc->HeapBottom = pc->SavedHeapBottom;
+    pc->StackFrame = pc->SavedStackFrame;
+    pc->HeapStackTop = pc->SavedHeapStackTop;
 }
 
 /* allocate some space on the stack, in the current stack frame
@@ -114,11 +284,67 @@ int HeapPopStackFrame(Picoc* pc) {
 
 /* allocate some dynamically allocated memory. memory is cleared. can return nullptr if out of memory */
 void* HeapAllocMem(Picoc* pc, int Size) {
-    return calloc(Size, 1);
+    return HeapArenaAlloc(&pc->InterpreterHeap, Size);
 }
 
-/* free some dynamically allocated memory */
+/* free some dynamically allocated memory. small blocks go back to their bucket, their chunk is only released by
+ * HeapCleanup() */
 void HeapFreeMem(Picoc* pc, void* Mem) {
-    free(Mem);
+    HeapArenaFree(&pc->InterpreterHeap, Mem);
 }
 
+/* allocate memory for the program. memory is cleared. the validation fails if the program would have more than
+ * GuestHeapLimit bytes allocated */
+void *HeapAllocGuest(struct ParseState *Parser, unsigned long long Size) {
+    Picoc *pc = Parser->pc;
+    void *NewMem = nullptr;
+
+    if (Size < INT_MAX - HEAP_BIG_NODE_SIZE - HEAP_HEADER_SIZE && pc->GuestHeapStats.InUse + MEM_ALIGN(Size) <= pc->GuestHeapLimit)
+        NewMem = HeapArenaAlloc(&pc->GuestHeap, (int)Size);
+
+    if (NewMem == nullptr)
+        ProgramFailWithExitCode(Parser, 251, "Out of memory, the program allocated %llu bytes and asked for %llu more",
+                                pc->GuestHeapStats.InUse, Size);
+
+    pc->GuestHeapStats.InUse += HeapBlockSize(NewMem);
+    if (pc->GuestHeapStats.InUse > pc->GuestHeapStats.Peak)
+        pc->GuestHeapStats.Peak = pc->GuestHeapStats.InUse;
+    pc->GuestHeapStats.Allocations++;
+    return NewMem;
+}
+
+/* resize memory of the program, keeping the block if the new size fits it and uses at least half of it */
+void *HeapReallocGuest(struct ParseState *Parser, void *Mem, unsigned long long Size) {
+    unsigned int OldSize;
+    void *NewMem;
+
+    if (Mem == nullptr)
+        return HeapAllocGuest(Parser, Size);
+
+    if (Size == 0) {
+        HeapFreeGuest(Parser->pc, Mem);
+        return nullptr;
+    }
+
+    OldSize = HeapBlockSize(Mem);
+    if (Size <= OldSize && Size * 2 >= OldSize) {
+        /* clear what's given up so that growing again finds it cleared like a new block */
+        memset((char *)Mem + Size, '\0', OldSize - Size);
+        return Mem;
+    }
+
+    NewMem = HeapAllocGuest(Parser, Size);
+    memcpy(NewMem, Mem, Size < OldSize ? Size : OldSize);
+    HeapFreeGuest(Parser->pc, Mem);
+    return NewMem;
+}
+
+/* free memory of the program */
+void HeapFreeGuest(Picoc *pc, void *Mem) {
+    if (Mem == nullptr)
+        return;
+
+    pc->GuestHeapStats.InUse -= HeapBlockSize(Mem);
+    pc->GuestHeapStats.Frees++;
+    HeapArenaFree(&pc->GuestHeap, Mem);
+}
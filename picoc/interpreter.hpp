@@ -81,14 +81,17 @@ typedef struct Picoc_Struct Picoc;
 #include "lextoken.hpp"
 
 #include "Shadows.hpp"
+#include "GotoLabels.hpp"
+#include "SwitchTables.hpp"
+#include "Scopes.hpp"
 
 /* hash table data structure */
 struct TableEntry
 {
-    struct TableEntry *Next;        /* next item in this hash chain */
     const char *DeclFileName;       /* where the variable was declared */
     unsigned short DeclLine;
     unsigned short DeclColumn;
+    unsigned int Hash;              /* the hash of the key, 0 if the slot is free */
 
     union TableEntryPayload
     {
@@ -99,7 +102,11 @@ struct TableEntry
             Shadows * ValShadows; /* shadowed values mapped by ScopeID */ // TODO the TableEntries are memset to 0, is that ok?
         } v;                        /* used for tables of values */
 
-        char Key[1];                /* dummy size - used for the shared string table */
+        struct StringEntry
+        {
+            char *Key;              /* the string, kept in the StringChunks */
+            unsigned Len;
+        } s;                        /* used for the shared string table */
 
         struct BreakpointEntry      /* defines a breakpoint */
         {
@@ -111,20 +118,52 @@ struct TableEntry
     } p;
 };
 
+/* the storage of the shared strings */
+struct StringChunk
+{
+    struct StringChunk *Next;
+    unsigned Size;                  /* the number of characters after the chunk */
+    unsigned Used;
+};
+
 struct Table
 {
-    short Size;
-    bool OnHeap;
-    struct TableEntry **HashTable;
+    unsigned Size;                  /* the number of slots, a power of two */
+    unsigned Count;                 /* the number of entries */
+    bool OnHeap;                    /* the slots were allocated by the table */
+    struct TableEntry *HashTable;   /* the slots, the entries are found by linear probing */
 };
 
-/* used in dynamic memory allocation */
+#define FREELIST_BUCKETS 64                         /* freelists for 8, 16, 24 ... 512 byte allocs */
+
+/* used in dynamic memory allocation. the size is kept in front of every block, the link is only used while a small
+ * block waits in its free list */
 struct AllocNode
 {
     unsigned int Size;
     struct AllocNode *NextFree;
 };
 
+/* memory handed out in blocks. the small blocks are bumped off chunks and go back to their bucket when freed, the big
+ * ones are allocated one by one. everything is released at once by HeapCleanup() */
+struct HeapArena
+{
+    struct HeapChunk *Chunks;
+    char *ChunkTop;                 /* the next free byte of the newest chunk */
+    char *ChunkEnd;
+    struct AllocNode *FreeListBucket[FREELIST_BUCKETS];      /* we keep a pool of freelist buckets to reduce fragmentation */
+    struct HeapBigNode *BigList;                             /* the blocks which don't fit in a bucket */
+};
+
+/* what the interpreted program did with its heap */
+struct GuestHeapStats
+{
+    unsigned long long InUse;       /* bytes allocated and not freed yet */
+    unsigned long long Peak;        /* the most bytes in use at once */
+    unsigned long long Allocations;
+    unsigned long long Frees;
+};
+
 #include "RunMode.hpp"
 
 /* how a condition was evaluated */
@@ -143,42 +182,48 @@ struct ValueList {
     }
 };
 
-/* parser state - has all this detail so we can parse nested files */
-struct ParseState
+/* where a parser is in its tokens. saving and restoring a position only copies this part of the parser state */
+struct ParseCursor
 {
-    Picoc *pc;                  /* the picoc instance this parser is a part of */
     const unsigned char *Pos;   /* the character position in the source text */
-    char *FileName;             /* what file we're executing (registered string) */
     size_t Line;             /* line number we're executing */
     short unsigned int CharacterPos;     /* character/column in the line we're executing */
+    short int HashIfLevel;      /* how many "if"s we're nested down */
+    short int HashIfEvaluateToLevel;    /* if we're not evaluating an if branch, what the last evaluated level was */
+    char FreshGotoSearch;
+    char SkipIntrinsic;
+    Value *LastNonDetValue;
+};
+
+/* parser state - has all this detail so we can parse nested files */
+struct ParseState : ParseCursor
+{
+    Picoc *pc;                  /* the picoc instance this parser is a part of */
+    char *FileName;             /* what file we're executing (registered string) */
+    const char *SourceText;     /* the entire source text */
+    // jsv:
+    void (*DebuggerCallback)(ParseState*, bool, std::size_t const&); /* calls a callback when breakpoint reached */
     enum RunMode Mode;          /* whether to skip or run code */
     int SearchLabel;            /* what case label we're searching for */
     const char *SearchGotoLabel;/* what goto label we're searching for */
-    const char *SourceText;     /* the entire source text */
-    short int HashIfLevel;      /* how many "if"s we're nested down */
-    short int HashIfEvaluateToLevel;    /* if we're not evaluating an if branch, what the last evaluated level was */
     enum ConditionControl LastConditionBranch;
     char DebugMode;             /* debugging mode */
     int ScopeID;                /* for keeping track of local variables (free them after they go out of scope) */
-    // jsv:
-    void (*DebuggerCallback)(ParseState*, bool, std::size_t const&); /* calls a callback when breakpoint reached */
     const char * EnterFunction;
     const char * CurrentFunction;
     const char * ReturnFromFunction;
     struct ValueList * ResolvedNonDetVars;
-    char FreshGotoSearch;
-    char SkipIntrinsic;
-    Value *LastNonDetValue;
+    GotoLabelIndex *GotoLabels; /* blocks and labels of the function body being run, or nullptr */
+    SwitchJumpTables *SwitchTables;    /* case dispatch for the switches of the function body being run, or nullptr */
 };
 
 
 /* values */
 #include "BaseType.hpp"
 
-struct NonDetList {
-    struct NonDetList * Next;
-    bool IsNonDet;
-};
+/* the nd flags of array elements are packed into words, one bit per element */
+typedef unsigned long NonDetWord;
+#define NON_DET_WORD_BITS (8 * sizeof(NonDetWord))
 
 /* data type */
 struct ValueType
@@ -197,8 +242,8 @@ struct ValueType
     int StaticQualifier;            /* true if it's a static */
     // jsv
     bool IsNonDet;                  /* flag for when the variable is non-deterministic */
-    struct NonDetList *NDList;     /* list of nd array element flags */
-    int NDListSize;                 /* the number of elements allocated in the list*/
+    NonDetWord *NDList;             /* bitset of nd array element flags */
+    int NDListSize;                 /* the number of elements in the bitset */
 };
 
 /* function definition */
@@ -211,6 +256,8 @@ struct FuncDef
     char **ParamName;               /* array of parameter names */
     void (*Intrinsic)(struct ParseState *, Value *, Value **, int );            /* intrinsic call address or nullptr */
     struct ParseState Body;         /* lexical tokens of the function body if not intrinsic */
+    const struct LibraryFunction *LazyFunction;     /* the library function this stub is defined as when it's first used, or nullptr */
+    const struct LibraryImageFunction *LazyImage;   /* the image to define it from, or nullptr to parse its prototype */
 };
 
 /* macro definition */
@@ -219,6 +266,8 @@ struct MacroDef
     int NumParams;                  /* the number of parameters */
     char **ParamName;               /* array of parameter names */
     struct ParseState Body;         /* lexical tokens of the function body if not intrinsic */
+    const struct LibraryFunction *LazyFunction;     /* the library function this stub is defined as when it's first used, or nullptr */
+    const struct LibraryImageFunction *LazyImage;   /* the image to define it from, or nullptr to parse its prototype */
 };
 
 /* values */
@@ -277,7 +326,8 @@ struct StackFrame
     Value **Parameter;               /* array of parameter values */
     int NumParams;                          /* the number of parameters */
     struct Table LocalTable;                /* the local variables and parameters */
-    struct TableEntry *LocalHashTable[LOCAL_TABLE_SIZE];
+    struct TableEntry LocalHashTable[LOCAL_TABLE_SIZE];
+    ScopeEntries *Scopes;                   /* the local table entries of each block scope, or nullptr */
     struct StackFrame *PreviousStackFrame;  /* the next lower stack frame */
 };
 
@@ -360,9 +410,7 @@ struct IncludeLibrary
     struct IncludeLibrary *NextLib;
 };
 
-#define FREELIST_BUCKETS 8                          /* freelists for 4, 8, 12 ... 32 byte allocs */
-#define SPLIT_MEM_THRESHOLD 16                      /* don't split memory which is close in size */
-#define BREAKPOINT_TABLE_SIZE 21
+#define BREAKPOINT_TABLE_SIZE 32
 
 
 /* the entire state of the picoc system */
@@ -371,7 +419,7 @@ struct Picoc_Struct
     /* parser global data */
     struct Table GlobalTable;
     struct CleanupTokenNode *CleanupTokenList;
-    struct TableEntry *GlobalHashTable[GLOBAL_TABLE_SIZE];
+    ScopeNumbering *ScopeIDs;
     
     /* lexer global data */
     struct TokenLine *InteractiveHead;
@@ -381,11 +429,9 @@ struct Picoc_Struct
     union AnyValue LexAnyValue;
     Value LexValue;
     struct Table ReservedWordTable;
-    struct TableEntry *ReservedWordHashTable[RESERVED_WORD_TABLE_SIZE];
 
     /* the table of string literal values */
     struct Table StringLiteralTable;
-    struct TableEntry *StringLiteralHashTable[STRING_LITERAL_TABLE_SIZE];
     
     /* the stack */
     struct StackFrame *TopStackFrame;
@@ -409,8 +455,20 @@ struct Picoc_Struct
     void *HeapStackTop;                 /* the top of the stack */
 #endif
 
-    struct AllocNode *FreeListBucket[FREELIST_BUCKETS];      /* we keep a pool of freelist buckets to reduce fragmentation */
-    struct AllocNode *FreeListBig;                           /* free memory which doesn't fit in a bucket */
+    /* the dynamically allocated memory of the interpreter */
+    struct HeapArena InterpreterHeap;
+
+    /* the memory the interpreted program allocates with malloc() and friends */
+    struct HeapArena GuestHeap;
+    unsigned long long GuestHeapLimit;  /* the most bytes the program may have allocated at once */
+    struct GuestHeapStats GuestHeapStats;
+
+    /* scratch stack for evaluating witness assumptions, the program's stack is parked meanwhile */
+    unsigned char *AssumptionStackMemory;
+    unsigned char *SavedHeapMemory;
+    void *SavedHeapBottom;
+    void *SavedStackFrame;
+    void *SavedHeapStackTop;
 
     /* types */    
     struct ValueType UberType;
@@ -458,12 +516,11 @@ struct Picoc_Struct
     struct ValueType FloatNDType;
     /* debugger */
     struct Table BreakpointTable;
-    struct TableEntry *BreakpointHashTable[BREAKPOINT_TABLE_SIZE];
     int BreakpointCount;
     int DebugManualBreak;
     
 	/* Verifier Error Function Name, if any */
-	const char *VerifierErrorFuncName;
+	const char *VerifierErrorFuncName;  /* registered, compared by address */
     /* Whether the Error Function was called*/
     bool VerifierErrorFunctionWasCalled;
 	
@@ -486,21 +543,27 @@ struct Picoc_Struct
     
     /* string table */
     struct Table StringTable;
-    struct TableEntry *StringHashTable[STRING_TABLE_SIZE];
+    struct StringChunk *StringChunks;   /* the first one is being filled */
     char *StrEmpty;
+    char *StrVerifierAssume;    /* registered once, function calls compare against it by address */
 };
 
 /* table.c */
 namespace nitwit {
     namespace table {
         void TableInit(Picoc *pc);
+        uint64_t TableHash(const char *Key, unsigned Len);
         char* TableStrRegister(Picoc *pc, const char *Str, unsigned Len=0);
-        void TableInitTable(Table *Tbl, TableEntry **HashTable, unsigned Size, bool OnHeap);
+        void TableInitTable(Picoc *pc, Table *Tbl, TableEntry *HashTable, unsigned Size);
+        void TableFree(Picoc *pc, Table *Tbl);
+        unsigned int TableEntryHash(unsigned long long Hash);
+        TableEntry *TableSearchHash(Table *Tbl, unsigned int Hash, int (*Matches)(const TableEntry *, const void *), const void *Key, unsigned *AddAt);
+        TableEntry *TableAdd(Picoc *pc, Table *Tbl, unsigned int Hash, unsigned AddAt);
+        void TableRemove(Table *Tbl, TableEntry *Entry);
         int TableSet(Picoc *pc, Table *Tbl, char *Key, Value *Val, const char *DeclFileName, unsigned DeclLine, unsigned DeclColumn);
         int TableGet(Table *Tbl, const char *Key, Value **Val, const char **DeclFileName, unsigned *DeclLine, unsigned *DeclColumn);
         Value* TableDelete(Picoc *pc, Table *Tbl, const char *Key);
         char* TableSetIdentifier(Picoc *pc, Table *Tbl, const char *Ident, unsigned IdentLen);
-        void TableStrFree(Picoc *pc);
         TableEntry *TableSearch(Table *Tbl, const char *Key, unsigned *AddAt);
     }
 }
@@ -517,6 +580,8 @@ namespace nitwit {
         LexToken LexRawPeekToken(ParseState *Parser);
         void LexToEndOfLine(ParseState *Parser);
         void *LexCopyTokens(ParseState *StartParser, ParseState *EndParser);
+        GotoLabelIndex *LexIndexGotoLabels(ParseState *Body);
+        int LexIndexSwitch(ParseState *Parser, std::vector<SwitchJumpTables::Target> &CaseLabels, SwitchJumpTables::Table &Table);
         void LexInteractiveClear(Picoc *pc, ParseState *Parser);
         void LexInteractiveCompleted(Picoc *pc, ParseState *Parser);
         void LexInteractiveStatementPrompt(Picoc *pc);
@@ -533,7 +598,7 @@ namespace nitwit {
         enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemicolon);
         Value *ParseFunctionDefinition(ParseState *Parser, ValueType *ReturnType, char *Identifier, bool IsPtrDecl);
         void ParseCleanup(Picoc *pc);
-        void ParserCopyPos(struct ParseState *To, struct ParseState *From);
+        void ParserCopyPos(struct ParseCursor *To, const struct ParseCursor *From);
         void ParserCopy(struct ParseState *To, struct ParseState *From);
         void ConditionCallback(struct ParseState *Parser, bool Condition);
     }
@@ -581,8 +646,8 @@ int TypeIsForwardDeclared(struct ParseState *Parser, struct ValueType *Typ);
 bool TypeIsNonDeterministic(struct ValueType *Typ);
 /* array element non deterministic type functions */
 void initNonDetList(struct ParseState * Parser, struct ValueType * Type, int ArraySize);
-bool getNonDetListElement(NonDetList * List, int ArrayIndex);
-void setNonDetListElement(NonDetList * List, int ArrayIndex, bool nonDet);
+bool getNonDetListElement(NonDetWord * List, int ArrayIndex);
+void setNonDetListElement(NonDetWord * List, int ArrayIndex, bool nonDet);
 struct ValueType* TypeGetDeterministic(struct ParseState * Parser, struct ValueType * Typ);
 struct ValueType* TypeGetNonDeterministic(struct ParseState * Parser, struct ValueType * Typ);
 int TypeIsUnsigned(struct ValueType * Typ);
@@ -590,6 +655,8 @@ int TypeIsUnsigned(struct ValueType * Typ);
 /* heap.c */
 void HeapInit(Picoc *pc, int StackSize);
 void HeapCleanup(Picoc *pc);
+void HeapEnterAssumptionStack(Picoc *pc);
+void HeapLeaveAssumptionStack(Picoc *pc);
 void *HeapAllocStack(Picoc *pc, int Size);
 int HeapPopStack(Picoc *pc, void *Addr, int Size);
 void HeapUnpopStack(Picoc *pc, int Size);
@@ -597,6 +664,9 @@ void HeapPushStackFrame(Picoc *pc);
 int HeapPopStackFrame(Picoc *pc);
 void *HeapAllocMem(Picoc *pc, int Size);
 void HeapFreeMem(Picoc *pc, void *Mem);
+void *HeapAllocGuest(struct ParseState *Parser, unsigned long long Size);
+void *HeapReallocGuest(struct ParseState *Parser, void *Mem, unsigned long long Size);
+void HeapFreeGuest(Picoc *pc, void *Mem);
 
 /* variable.c */
 void VariableInit(Picoc *pc);
@@ -618,6 +688,7 @@ Value *
 VariableDefine(Picoc *pc, ParseState *Parser, char *Ident, Value *InitValue, ValueType *Typ, int MakeWritable, bool b);
 Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *Ident, struct ValueType *Typ, int IsStatic, int *FirstVisit);
 int VariableDefined(Picoc *pc, const char *Ident);
+int VariableLookup(Picoc *pc, const char *Ident, Value **LVal);
 int VariableDefinedAndOutOfScope(Picoc *pc, const char *Ident);
 void VariableRealloc(struct ParseState *Parser, Value *FromValue, int NewSize);
 void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, Value **LVal);
@@ -634,6 +705,9 @@ void ShadowTableCleanup(Picoc *pc, struct Table *HashTable);
 void BasicIOInit(Picoc *pc);
 void LibraryInit(Picoc *pc);
 void LibraryAdd(Picoc *pc, struct Table *GlobalTable, const char *LibraryName, struct LibraryFunction *FuncList);
+#ifdef LAZY_LIBRARY
+void LibraryBind(Picoc *pc, const char *Ident, Value **FuncValue);
+#endif
 void CLibraryInit(Picoc *pc);
 void PrintCh(char OutCh, IOFILE *Stream);
 void PrintSimpleInt(long Num, IOFILE *Stream);
@@ -26,11 +26,26 @@ namespace nitwit {
 
 #define LEXER_INC(l) ( (l)->Pos++, (l)->CharacterPos++ )
 #define LEXER_INCN(l, n) ( (l)->Pos+=(n), (l)->CharacterPos+=(n) )
-#define TOKEN_DATA_OFFSET 2
 
 #define MAX_CHAR_VALUE 255      /* maximum value which can be represented by a "char" data type */
 
 LexToken LexScanGetToken(Picoc *pc, LexState *Lexer, Value **Value);
+
+/* a token of a tokenised source text. every token takes the same room, so the next one is always right behind it,
+ * and carries its line, so there are no end of line tokens to count */
+struct LexTokenRecord
+{
+    unsigned char Token;            /* a LexToken, first so that LexRawPeekToken() can read it as a byte */
+    unsigned char CharacterPos;     /* where the token before it ended */
+    unsigned int Line;
+    union {
+        char *Pointer;
+        long long LongLong;
+        double FP;
+    } Value;                        /* LexTokenSize() bytes of it are used */
+};
+
+#define TOKEN_RECORD(Pos) ((const LexTokenRecord *)(Pos))
 struct ReservedWord
 {
     const char *Word;
@@ -105,7 +120,7 @@ static struct ReservedWord ReservedWords[] =
 /* initialise the lexer */
 void LexInit(Picoc *pc)
 {
-    nitwit::table::TableInitTable(&pc->ReservedWordTable, &pc->ReservedWordHashTable[0], RESERVED_WORD_TABLE_SIZE, true);
+    nitwit::table::TableInitTable(pc, &pc->ReservedWordTable, nullptr, RESERVED_WORD_TABLE_SIZE);
 
     for (unsigned Count = 0; Count < sizeof(ReservedWords) / sizeof(ReservedWord); Count++)
     {
@@ -128,6 +143,8 @@ void LexCleanup(Picoc *pc)
 
     for (unsigned Count = 0; Count < sizeof(ReservedWords) / sizeof(ReservedWord); Count++)
         nitwit::table::TableDelete(pc, &pc->ReservedWordTable, nitwit::table::TableStrRegister(pc, ReservedWords[Count].Word));
+
+    nitwit::table::TableFree(pc, &pc->ReservedWordTable);
 }
 
 /* check if a word is a reserved word - used while scanning */
@@ -620,65 +637,69 @@ int LexTokenSize(LexToken const& Token)
 void *LexTokenise(Picoc *pc, LexState *Lexer, int *TokenLen)
 {
     LexToken Token;
-    void *HeapMem;
     Value *GotValue;
-    int MemUsed = 0;
     int ValueSize;
-    int ReserveSpace = (Lexer->End - Lexer->Pos) * 4 + 16;
-    void *TokenSpace = HeapAllocStack(pc, ReserveSpace);
-    char *TokenPos = (char *)TokenSpace;
+    int NumTokens = 0;
+    int MaxTokens = (Lexer->End - Lexer->Pos) / 4 + 16;      /* grows if the source is denser than that */
+    auto *Tokens = static_cast<LexTokenRecord *>(HeapAllocMem(pc, MaxTokens * sizeof(LexTokenRecord)));
+    unsigned int Line = Lexer->Line;
     int LastCharacterPos = 0;
 
-    if (TokenSpace == nullptr)
+    if (Tokens == nullptr)
         LexFail(pc, Lexer, "out of memory");
 
     do {
-        /* store the token at the end of the stack area */
         Token = LexScanGetToken(pc, Lexer, &GotValue);
 
 #ifdef DEBUG_LEXER
         printf("Token: %02x\n", Token);
 #endif
-        *(unsigned char *)TokenPos = Token;
-        TokenPos++;
-        MemUsed++;
+        if (Token == TokenEndOfLine) {
+            /* the tokens after it get the next line */
+            Line++;
+            LastCharacterPos = Lexer->CharacterPos;
+            continue;
+        }
+
+        if (NumTokens == MaxTokens) {
+            auto *MoreTokens = static_cast<LexTokenRecord *>(HeapAllocMem(pc, MaxTokens * 2 * sizeof(LexTokenRecord)));
+            if (MoreTokens == nullptr)
+                LexFail(pc, Lexer, "out of memory");
 
-        *(unsigned char *)TokenPos = (unsigned char)LastCharacterPos;
-        TokenPos++;
-        MemUsed++;
+            memcpy(MoreTokens, Tokens, NumTokens * sizeof(LexTokenRecord));
+            HeapFreeMem(pc, Tokens);
+            Tokens = MoreTokens;
+            MaxTokens *= 2;
+        }
+
+        LexTokenRecord *Record = &Tokens[NumTokens++];
+        Record->Token = Token;
+        Record->CharacterPos = (unsigned char)LastCharacterPos;
+        Record->Line = Line;
 
         ValueSize = LexTokenSize(Token);
         if (ValueSize > 0) {
             /* store a value as well */
-            memcpy((void *)TokenPos, (void *)GotValue->Val, ValueSize);
-            TokenPos += ValueSize;
-            MemUsed += ValueSize;
+            memcpy((void *)&Record->Value, (void *)GotValue->Val, ValueSize);
         }
 
         LastCharacterPos = Lexer->CharacterPos;
 
     } while (Token != TokenEOF);
 
-    HeapMem = HeapAllocMem(pc, MemUsed);
-    if (HeapMem == nullptr)
-        LexFail(pc, Lexer, "out of memory");
-
-    assert(ReserveSpace >= MemUsed);
-    memcpy(HeapMem, TokenSpace, MemUsed);
-    HeapPopStack(pc, TokenSpace, ReserveSpace);
 #ifdef DEBUG_LEXER
     {
         int Count;
         printf("Tokens: ");
-        for (Count = 0; Count < MemUsed; Count++)
-            printf("%02x ", *((unsigned char *)HeapMem+Count));
+        for (Count = 0; Count < NumTokens; Count++)
+            printf("%02x:%u ", Tokens[Count].Token, Tokens[Count].Line);
         printf("\n");
     }
 #endif
     if (TokenLen)
-        *TokenLen = MemUsed;
+        *TokenLen = NumTokens * sizeof(LexTokenRecord);
 
-    return HeapMem;
+    return Tokens;
 }
 
 /* lexically analyse some source text */
@@ -724,6 +745,8 @@ void LexInitParser(ParseState *Parser, Picoc *pc, const char *SourceText, void *
     Parser->FreshGotoSearch = FALSE;
     Parser->SkipIntrinsic = FALSE;
     Parser->LastNonDetValue = nullptr;
+    Parser->GotoLabels = nullptr;
+    Parser->SwitchTables = nullptr;
 }
 
 /* get the next token, without pre-processing */
@@ -739,14 +762,8 @@ LexToken LexGetRawToken(ParseState *Parser, Value **Value, bool IncPos)
         if (Parser->Pos == nullptr && pc->InteractiveHead != nullptr)
             Parser->Pos = pc->InteractiveHead->Tokens;
 
-        if (Parser->FileName != pc->StrEmpty || pc->InteractiveHead != nullptr) {
-            /* skip leading newlines */
-            while ((Token = (LexToken)*(unsigned char *)Parser->Pos) == TokenEndOfLine)
-            {
-                Parser->Line++;
-                Parser->Pos += TOKEN_DATA_OFFSET;
-            }
-        }
+        if (Parser->FileName != pc->StrEmpty || pc->InteractiveHead != nullptr)
+            Token = (LexToken)TOKEN_RECORD(Parser->Pos)->Token;
 
         if (Parser->FileName == pc->StrEmpty && (pc->InteractiveHead == nullptr || Token == TokenEOF)) {
             /* we're at the end of an interactive input token list */
@@ -755,7 +772,7 @@ LexToken LexGetRawToken(ParseState *Parser, Value **Value, bool IncPos)
             int LineBytes;
             TokenLine *LineNode;
 
-            if (pc->InteractiveHead == nullptr || (unsigned char *)Parser->Pos == &pc->InteractiveTail->Tokens[pc->InteractiveTail->NumBytes-TOKEN_DATA_OFFSET]) {
+            if (pc->InteractiveHead == nullptr || (unsigned char *)Parser->Pos == &pc->InteractiveTail->Tokens[pc->InteractiveTail->NumBytes-sizeof(LexTokenRecord)]) {
                 /* get interactive input */
                 if (pc->LexUseStatementPrompt)
                 {
@@ -788,9 +805,9 @@ LexToken LexGetRawToken(ParseState *Parser, Value **Value, bool IncPos)
             }
             else {
                 /* go to the next token line */
-                if (Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET]) {
+                if (Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-sizeof(LexTokenRecord)]) {
                     /* scan for the line */
-                    for (pc->InteractiveCurrentLine = pc->InteractiveHead; Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET]; pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next)
+                    for (pc->InteractiveCurrentLine = pc->InteractiveHead; Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-sizeof(LexTokenRecord)]; pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next)
                     { assert(pc->InteractiveCurrentLine->Next != nullptr); }
                 }
 
@@ -802,9 +819,10 @@ LexToken LexGetRawToken(ParseState *Parser, Value **Value, bool IncPos)
 
             Token = (LexToken)*(unsigned char *)Parser->Pos;
         }
-    } while ((Parser->FileName == pc->StrEmpty && Token == TokenEOF) || Token == TokenEndOfLine);
+    } while (Parser->FileName == pc->StrEmpty && Token == TokenEOF);
 
-    Parser->CharacterPos = *((unsigned char *)Parser->Pos + 1);
+    Parser->Line = TOKEN_RECORD(Parser->Pos)->Line;
+    Parser->CharacterPos = TOKEN_RECORD(Parser->Pos)->CharacterPos;
     ValueSize = LexTokenSize(Token);
     if (ValueSize > 0) {
         /* this token requires a value - unpack it */
@@ -823,7 +841,7 @@ LexToken LexGetRawToken(ParseState *Parser, Value **Value, bool IncPos)
                 default: break;
             }
 
-            memcpy((void *)pc->LexValue.Val, (void *)((char *)Parser->Pos + TOKEN_DATA_OFFSET), ValueSize);
+            memcpy((void *)pc->LexValue.Val, (void *)&TOKEN_RECORD(Parser->Pos)->Value, ValueSize);
             pc->LexValue.ValOnHeap = FALSE;
             pc->LexValue.ValOnStack = FALSE;
             pc->LexValue.IsLValue = FALSE;
@@ -831,15 +849,11 @@ LexToken LexGetRawToken(ParseState *Parser, Value **Value, bool IncPos)
             *Value = &pc->LexValue;
         }
 
-        if (IncPos)
-            Parser->Pos += ValueSize + TOKEN_DATA_OFFSET;
-    }
-    else
-    {
-        if (IncPos && Token != TokenEOF)
-            Parser->Pos += TOKEN_DATA_OFFSET;
     }
 
+    if (IncPos && Token != TokenEOF)
+        Parser->Pos += sizeof(LexTokenRecord);
+
 #ifdef DEBUG_LEXER
     printf("Got token=%02x inc=%d pos=%d\n", Token, IncPos, Parser->CharacterPos);
 #endif
@@ -1019,10 +1033,12 @@ LexToken LexRawPeekToken(ParseState *Parser)
 /* find the end of the line */
 void LexToEndOfLine(ParseState *Parser)
 {
+    size_t Line = Parser->Line;
+
     while (TRUE)
     {
-        LexToken Token = (LexToken)*(unsigned char *)Parser->Pos;
-        if (Token == TokenEndOfLine || Token == TokenEOF) {
+        const LexTokenRecord *Record = TOKEN_RECORD(Parser->Pos);
+        if (Record->Line != Line || Record->Token == TokenEOF) {
             return;
         }
         else {
@@ -1045,7 +1061,7 @@ void *LexCopyTokens(ParseState *StartParser, ParseState *EndParser)
     if (pc->InteractiveHead == nullptr) {
         /* non-interactive mode - copy the tokens */
         MemSize = EndParser->Pos - StartParser->Pos;
-        NewTokens = static_cast<unsigned char *>(VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE));
+        NewTokens = static_cast<unsigned char *>(VariableAlloc(pc, StartParser, MemSize + sizeof(LexTokenRecord), TRUE));
         memcpy(NewTokens, (void *)StartParser->Pos, MemSize);
     }
     else {
@@ -1056,38 +1072,195 @@ void *LexCopyTokens(ParseState *StartParser, ParseState *EndParser)
         if (EndParser->Pos >= StartParser->Pos && EndParser->Pos < &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes]) {
             /* all on a single line */
             MemSize = EndParser->Pos - StartParser->Pos;
-            NewTokens = static_cast<unsigned char *>(VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE));
+            NewTokens = static_cast<unsigned char *>(VariableAlloc(pc, StartParser, MemSize + sizeof(LexTokenRecord), TRUE));
             memcpy(NewTokens, (void *)StartParser->Pos, MemSize);
         }
         else {
             /* it's spread across multiple lines */
-            MemSize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
+            MemSize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-sizeof(LexTokenRecord)] - Pos;
 
             for (ILine = pc->InteractiveCurrentLine->Next; ILine != nullptr && (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumBytes]); ILine = ILine->Next)
-                MemSize += ILine->NumBytes - TOKEN_DATA_OFFSET;
+                MemSize += ILine->NumBytes - sizeof(LexTokenRecord);
 
             assert(ILine != nullptr);
             MemSize += EndParser->Pos - &ILine->Tokens[0];
-            NewTokens = static_cast<unsigned char *>(VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE));
+            NewTokens = static_cast<unsigned char *>(VariableAlloc(pc, StartParser, MemSize + sizeof(LexTokenRecord), TRUE));
 
-            CopySize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
+            CopySize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-sizeof(LexTokenRecord)] - Pos;
             memcpy(NewTokens, Pos, CopySize);
             NewTokenPos = NewTokens + CopySize;
             for (ILine = pc->InteractiveCurrentLine->Next; ILine != nullptr && (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumBytes]); ILine = ILine->Next)
             {
-                memcpy(NewTokenPos, &ILine->Tokens[0], ILine->NumBytes - TOKEN_DATA_OFFSET);
-                NewTokenPos += ILine->NumBytes-TOKEN_DATA_OFFSET;
+                memcpy(NewTokenPos, &ILine->Tokens[0], ILine->NumBytes - sizeof(LexTokenRecord));
+                NewTokenPos += ILine->NumBytes-sizeof(LexTokenRecord);
             }
             assert(ILine != nullptr);
             memcpy(NewTokenPos, &ILine->Tokens[0], EndParser->Pos - &ILine->Tokens[0]);
         }
     }
 
-    NewTokens[MemSize] = (unsigned char)TokenEndOfFunction;
+    /* the end stays on the line of the last token */
+    auto *End = (LexTokenRecord *)(NewTokens + MemSize);
+    End->Token = TokenEndOfFunction;
+    End->Line = MemSize > 0 ? TOKEN_RECORD(NewTokens + MemSize - sizeof(LexTokenRecord))->Line : StartParser->Line;
 
     return NewTokens;
 }
 
+/* index the blocks and goto labels of a copied function body. returns nullptr if the body contains no goto */
+GotoLabelIndex *LexIndexGotoLabels(ParseState *Body)
+{
+    const unsigned char *Pos = Body->Pos;
+    std::vector<size_t> OpenBlocks;
+    const unsigned char *IdentPos = nullptr;
+    char *Ident = nullptr;
+    bool HasGoto = false;
+    auto *Index = new GotoLabelIndex();
+
+    for (LexToken Token = (LexToken)*Pos; Token != TokenEOF && Token != TokenEndOfFunction; Token = (LexToken)*Pos)
+    {
+        switch (Token)
+        {
+            case TokenLeftBrace:
+                OpenBlocks.push_back(Index->Blocks.size());
+                Index->Blocks.push_back({Pos + sizeof(LexTokenRecord), nullptr, 0, true});
+                break;
+
+            case TokenRightBrace:
+                if (!OpenBlocks.empty()) {
+                    Index->Blocks[OpenBlocks.back()].Close = Pos;
+                    Index->Blocks[OpenBlocks.back()].CloseLine = TOKEN_RECORD(Pos)->Line;
+                    OpenBlocks.pop_back();
+                }
+                break;
+
+            case TokenColon:
+                if (IdentPos != nullptr)
+                    Index->Labels.emplace_back(Ident, IdentPos);
+                break;
+
+            case TokenGoto:
+                HasGoto = true;
+                break;
+
+            case TokenHashDefine: case TokenHashInclude: case TokenHashIf: case TokenHashIfdef:
+            case TokenHashIfndef: case TokenHashElse: case TokenHashEndif:
+                /* the directive has to be seen by the parser, so none of the enclosing blocks may be skipped */
+                for (size_t Open: OpenBlocks)
+                    Index->Blocks[Open].Skippable = false;
+                break;
+
+            default:
+                break;
+        }
+
+        /* remember an identifier in case a ':' follows it */
+        if (Token == TokenIdentifier) {
+            IdentPos = Pos;
+            Ident = TOKEN_RECORD(Pos)->Value.Pointer;
+        } else {
+            IdentPos = nullptr;
+        }
+
+        Pos += sizeof(LexTokenRecord);
+    }
+
+    /* a block the body ends in before its '}' can't be stepped over */
+    for (size_t Open: OpenBlocks)
+        Index->Blocks[Open].Skippable = false;
+
+    if (!HasGoto) {
+        delete Index;
+        return nullptr;
+    }
+
+    std::sort(Index->Labels.begin(), Index->Labels.end());
+    return Index;
+}
+
+/* find the case and default statements of the switch body starting at the '{' under the parser. returns FALSE if
+ * they can't all be jumped to directly - when one is nested in a block or a statement, when a case value isn't made
+ * of constants alone or when there are preprocessor directives in the body */
+int LexIndexSwitch(ParseState *Parser, std::vector<SwitchJumpTables::Target> &CaseLabels, SwitchJumpTables::Table &Table)
+{
+    const unsigned char *Pos = Parser->Pos;
+    std::vector<bool> OpenBlocks;       /* for each open brace, whether it's the body of an inner switch */
+    bool InnerSwitch = false;
+    LexToken Previous = TokenNone;
+
+    Table.Default.Pos = nullptr;
+    Table.Close.Pos = nullptr;
+
+    for (LexToken Token = (LexToken)*Pos; Token != TokenEOF && Token != TokenEndOfFunction; Token = (LexToken)*Pos)
+    {
+        switch (Token)
+        {
+            case TokenSwitch:
+                InnerSwitch = true;
+                break;
+
+            case TokenLeftBrace:
+                OpenBlocks.push_back(InnerSwitch);
+                InnerSwitch = false;
+                break;
+
+            case TokenRightBrace:
+                OpenBlocks.pop_back();
+                if (OpenBlocks.empty()) {
+                    Table.Close = {Pos, TOKEN_RECORD(Pos)->Line};
+                    return TRUE;
+                }
+                break;
+
+            case TokenCase:
+            case TokenDefault:
+                if (std::find(OpenBlocks.begin() + 1, OpenBlocks.end(), true) != OpenBlocks.end())
+                    break;      /* belongs to an inner switch */
+
+                if (OpenBlocks.size() != 1 || (Previous != TokenLeftBrace && Previous != TokenRightBrace &&
+                                               Previous != TokenSemicolon && Previous != TokenColon))
+                    return FALSE;
+
+                if (Token == TokenDefault) {
+                    Table.Default = {Pos, TOKEN_RECORD(Pos)->Line};
+                    break;
+                }
+
+                CaseLabels.push_back({Pos, TOKEN_RECORD(Pos)->Line});
+                for (const unsigned char *Value = Pos + sizeof(LexTokenRecord); *Value != TokenColon;
+                     Value += sizeof(LexTokenRecord))
+                {
+                    switch ((LexToken)*Value)
+                    {
+                        case TokenIntegerConstant: case TokenUnsignedIntConstanst: case TokenLLConstanst:
+                        case TokenUnsignedLLConstanst: case TokenCharacterConstant:
+                        case TokenPlus: case TokenMinus: case TokenAsterisk: case TokenSlash: case TokenModulus:
+                        case TokenShiftLeft: case TokenShiftRight: case TokenAmpersand: case TokenArithmeticOr:
+                        case TokenArithmeticExor: case TokenUnaryExor: case TokenUnaryNot:
+                        case TokenOpenBracket: case TokenCloseBracket:
+                            break;
+
+                        default:
+                            return FALSE;
+                    }
+                }
+                break;
+
+            case TokenHashDefine: case TokenHashInclude: case TokenHashIf: case TokenHashIfdef:
+            case TokenHashIfndef: case TokenHashElse: case TokenHashEndif:
+                return FALSE;
+
+            default:
+                break;
+        }
+
+        Previous = Token;
+        Pos += sizeof(LexTokenRecord);
+    }
+
+    return FALSE;
+}
+
 /* indicate that we've completed up to this point in the interactive input and free expired tokens */
 void LexInteractiveClear(Picoc *pc, ParseState *Parser)
 {
@@ -184,6 +184,8 @@ Value *ParseFunctionDefinition(ParseState *Parser, ValueType *ReturnType, char *
 
         FuncValue->Val->FuncDef.Body = FuncBody;
         FuncValue->Val->FuncDef.Body.Pos = static_cast<const unsigned char *>(nitwit::lex::LexCopyTokens(&FuncBody, Parser));
+        FuncValue->Val->FuncDef.Body.GotoLabels = nitwit::lex::LexIndexGotoLabels(&FuncValue->Val->FuncDef.Body);
+        FuncValue->Val->FuncDef.Body.SwitchTables = new SwitchJumpTables();
 
     }
 
@@ -703,26 +705,19 @@ void ParserCopy(struct ParseState *To, struct ParseState *From)
 }
 
 /* copy where we're at in the parsing */
-void ParserCopyPos(struct ParseState *To, struct ParseState *From)
+void ParserCopyPos(struct ParseCursor *To, const struct ParseCursor *From)
 {
-    To->Pos = From->Pos;
-    To->Line = From->Line;
-    To->HashIfLevel = From->HashIfLevel;
-    To->HashIfEvaluateToLevel = From->HashIfEvaluateToLevel;
-    To->CharacterPos = From->CharacterPos;
-    To->FreshGotoSearch = From->FreshGotoSearch;
-    To->SkipIntrinsic = From->SkipIntrinsic;
-    To->LastNonDetValue = From->LastNonDetValue;
+    *To = *From;
 }
 
 /* parse a "for" statement */
 void ParseFor(struct ParseState *Parser)
 {
     bool Condition;
-    struct ParseState PreConditional;
-    struct ParseState PreIncrement;
-    struct ParseState PreStatement;
-    struct ParseState After;
+    struct ParseCursor PreConditional;
+    struct ParseCursor PreIncrement;
+    struct ParseCursor PreStatement;
+    struct ParseCursor After;
 
     enum RunMode OldMode = Parser->Mode;
 
@@ -814,6 +809,17 @@ enum RunMode ParseBlock(struct ParseState *Parser, int AbsorbOpenBrace, int Cond
     if (AbsorbOpenBrace && nitwit::lex::LexGetToken(Parser, nullptr, true) != TokenLeftBrace)
         ProgramFail(Parser, "'{' expected");
 
+    if (Parser->Mode == RunMode::RunModeGoto && Parser->GotoLabels != nullptr)
+    {
+        /* searching for a goto label - go straight to the '}' if the label can't be in here */
+        const GotoLabelIndex::Block *Block = Parser->GotoLabels->findBlock(Parser->Pos);
+        if (Block != nullptr && Block->Skippable && !Parser->GotoLabels->containsLabel(*Block, Parser->SearchGotoLabel))
+        {
+            Parser->Pos = Block->Close;
+            Parser->Line = Block->CloseLine;
+        }
+    }
+
     if (Parser->Mode == RunMode::RunModeSkip || !Condition)
     {
         /* condition failed - skip this block instead */
@@ -880,6 +886,43 @@ char *GetGotoIdentifier(const char *function_id, const char *goto_id) {
     return s;
 }
 
+/* get the case dispatch table of the switch body at the '{' under the parser, building it the first time this switch
+ * runs. returns nullptr if the body has to be searched for its case instead */
+const SwitchJumpTables::Table *ParseSwitchTable(struct ParseState *Parser)
+{
+    if (Parser->SwitchTables == nullptr)
+        return nullptr;
+
+    auto Found = Parser->SwitchTables->Tables.find(Parser->Pos);
+    if (Found == Parser->SwitchTables->Tables.end())
+    {
+        std::vector<SwitchJumpTables::Target> CaseLabels;
+        SwitchJumpTables::Table Table;
+        Table.Usable = nitwit::lex::LexIndexSwitch(Parser, CaseLabels, Table);
+
+        if (Table.Usable)
+        {
+            for (auto const& Label: CaseLabels)
+            {
+                /* the case values are constant, so they can all be worked out now */
+                struct ParseState CaseParser;
+                ParserCopy(&CaseParser, Parser);
+                CaseParser.Pos = Label.Pos;
+                CaseParser.Line = Label.Line;
+                CaseParser.Mode = RunMode::RunModeRun;
+                nitwit::lex::LexGetToken(&CaseParser, nullptr, true);
+
+                /* a duplicate case can't be reached, the first one wins */
+                Table.Cases.emplace((int)nitwit::expressions::ExpressionParseLongLong(&CaseParser), Label);
+            }
+        }
+
+        Found = Parser->SwitchTables->Tables.emplace(Parser->Pos, std::move(Table)).first;
+    }
+
+    return Found->second.Usable ? &Found->second : nullptr;
+}
+
 /* parse a statement */
 enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemicolon)
 {
@@ -887,17 +930,20 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
     Value *LexerValue;
     Value *VarValue;
     int Condition;
-    struct ParseState PreState;
+    const SwitchJumpTables::Table *SwitchTable;
+    struct ParseCursor PreState;
+    enum RunMode PreStateMode;
     enum LexToken Token;
     char GotoCallback = FALSE;
     char SkipDebugCheck = FALSE;
     bool isFunctionDeclaration = false;
 
     /* take note of where we are and then grab a token to see what statement we have */
-    ParserCopy(&PreState, Parser);
+    ParserCopyPos(&PreState, Parser);
+    PreStateMode = Parser->Mode;
     Token = nitwit::lex::LexGetToken(Parser, &LexerValue, true);
 
-    struct ParseState ParserPrePosition;
+    struct ParseCursor ParserPrePosition;
     ParserCopyPos(&ParserPrePosition, Parser);
 
     /* if we're debugging, check for a breakpoint */
@@ -923,12 +969,11 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
 
         case TokenIdentifier:
             /* might be a typedef-typed variable declaration or it might be an expression */
-            if (VariableDefined(Parser->pc, LexerValue->Val->Identifier))
+            if (VariableLookup(Parser->pc, LexerValue->Val->Identifier, &VarValue))
             {
-                VariableGet(Parser->pc, Parser, LexerValue->Val->Identifier, &VarValue);
                 if (VarValue->Typ->Base == BaseType::Type_Type)
                 {
-                    *Parser = PreState;
+                    ParserCopyPos(Parser, &PreState);
                     CheckTrailingSemicolon = ParseDeclaration(Parser, Token, isFunctionDeclaration);
                     break;
                 }
@@ -986,7 +1031,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
         case TokenIncrement:
         case TokenDecrement:
         case TokenOpenBracket:
-            *Parser = PreState;
+            ParserCopyPos(Parser, &PreState);
             debugf("ParseStatement found a (, going into ExpressionParse().\n");
             nitwit::expressions::ExpressionParse(Parser, &CValue);
             SkipDebugCheck = TRUE;
@@ -1018,7 +1063,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
             {
                 nitwit::lex::LexGetToken(Parser, nullptr, true);
                 if (ParseStatementMaybeRun(Parser,
-                        (!Condition && !(PreState.Mode == RunMode::RunModeGoto
+                        (!Condition && !(PreStateMode == RunMode::RunModeGoto
                         && Parser->Mode == RunMode::RunModeRun)), TRUE) != ParseResultOk)
                     ProgramFail(Parser, "statement expected");
             }
@@ -1027,7 +1072,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
 
         case TokenWhile:
             {
-                struct ParseState PreConditional;
+                struct ParseCursor PreConditional;
                 enum RunMode PreMode = Parser->Mode;
 
                 if (nitwit::lex::LexGetToken(Parser, nullptr, true) != TokenOpenBracket)
@@ -1060,7 +1105,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
 
         case TokenDo:
             {
-                struct ParseState PreStatement;
+                struct ParseCursor PreStatement;
                 enum RunMode PreMode = Parser->Mode;
                 ParserCopyPos(&PreStatement, Parser);
                 do
@@ -1119,7 +1164,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
 #ifdef NO_HEADER_INCLUDE
         case TokenExternType:
 #endif
-            *Parser = PreState;
+            ParserCopyPos(Parser, &PreState);
             CheckTrailingSemicolon = ParseDeclaration(Parser, Token, isFunctionDeclaration);
             break;
 #ifndef NO_HEADER_INCLUDE
@@ -1170,6 +1215,34 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
             if (nitwit::lex::LexGetToken(Parser, nullptr, false) != TokenLeftBrace)
                 ProgramFail(Parser, "'{' expected");
 
+            if (Parser->Mode == RunMode::RunModeGoto)
+            {
+                /* the condition wasn't evaluated, look for the goto label in the body rather than for a case */
+                ParseBlock(Parser, TRUE, TRUE);
+
+                if (Parser->Mode == RunMode::RunModeBreak)
+                    Parser->Mode = RunMode::RunModeRun;
+            }
+            else if (Parser->Mode == RunMode::RunModeRun && (SwitchTable = ParseSwitchTable(Parser)) != nullptr)
+            {
+                /* go straight to the case, default or end of the body */
+                int PrevScopeID = 0, ScopeID = VariableScopeBegin(Parser, &PrevScopeID);
+                const SwitchJumpTables::Target &Start = SwitchJumpTables::dispatch(*SwitchTable, Condition);
+
+                Parser->Pos = Start.Pos;
+                Parser->Line = Start.Line;
+                while (ParseStatement(Parser, TRUE) == ParseResultOk)
+                {}
+
+                if (nitwit::lex::LexGetToken(Parser, nullptr, true) != TokenRightBrace)
+                    ProgramFail(Parser, "'}' expected");
+
+                VariableScopeEnd(Parser, ScopeID, PrevScopeID);
+
+                if (Parser->Mode != RunMode::RunModeReturn)
+                    Parser->Mode = RunMode::RunModeRun;
+            }
+            else
             {
                 /* new block so we can store parser state */
                 enum RunMode OldMode = Parser->Mode;
@@ -1177,7 +1250,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
                 Parser->Mode = RunMode::RunModeCaseSearch;
                 Parser->SearchLabel = Condition;
 
-                ParseBlock(Parser, TRUE, (OldMode != RunMode::RunModeSkip) && (OldMode != RunMode::RunModeReturn));
+                ParseBlock(Parser, TRUE, OldMode == RunMode::RunModeRun);
 
                 if (Parser->Mode != RunMode::RunModeReturn)
                     Parser->Mode = OldMode;
@@ -1305,7 +1378,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
         }
 
         default:
-            *Parser = PreState;
+            ParserCopyPos(Parser, &PreState);
             return ParseResultError;
     }
     
@@ -1318,7 +1391,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
 
     /* if we're debugging, check for a breakpoint */
     if ((Parser->DebugMode && Parser->Mode == RunMode::RunModeRun && !SkipDebugCheck) || GotoCallback){
-        struct ParseState NowPosition;
+        struct ParseCursor NowPosition;
         ParserCopyPos(&NowPosition, Parser);
         ParserCopyPos(Parser, &ParserPrePosition);
 #ifdef DEBUG_WITNESS_EDGES
@@ -1367,36 +1440,61 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
     return ParseResultOk;
 }
 
+/* keep the tokens of a source file until ParseCleanup() */
+static void ParseAddCleanupTokens(Picoc *pc, void *Tokens, const char *Source, int CleanupSource)
+{
+    CleanupTokenNode *NewCleanupNode = static_cast<CleanupTokenNode *>(HeapAllocMem(pc, sizeof(struct CleanupTokenNode)));
+    if (NewCleanupNode == nullptr)
+        ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
+
+    NewCleanupNode->Tokens = Tokens;
+    if (CleanupSource)
+        NewCleanupNode->SourceText = Source;
+    else
+        NewCleanupNode->SourceText = nullptr;
+
+    NewCleanupNode->Next = pc->CleanupTokenList;
+    pc->CleanupTokenList = NewCleanupNode;
+}
+
 /* quick scan a source file for definitions */
 void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int RunIt, int CleanupNow,
                 int CleanupSource, int EnableDebugger, void (*DebuggerCallback)(ParseState*, bool, std::size_t const&))
 {
-    ParseState Parser;
-    ParseResult Ok;
-    CleanupTokenNode *NewCleanupNode;
     char *RegFileName = nitwit::table::TableStrRegister(pc, FileName);
 
     void *Tokens = nitwit::lex::LexAnalyse(pc, RegFileName, Source, SourceLen, nullptr);
 
     /* allocate a cleanup node so we can clean up the tokens later */
     if (!CleanupNow)
-    {
-        NewCleanupNode = static_cast<CleanupTokenNode *>(HeapAllocMem(pc, sizeof(struct CleanupTokenNode)));
-        if (NewCleanupNode == nullptr)
-            ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
+        ParseAddCleanupTokens(pc, Tokens, Source, CleanupSource);
 
-        NewCleanupNode->Tokens = Tokens;
-        if (CleanupSource)
-            NewCleanupNode->SourceText = Source;
-        else
-            NewCleanupNode->SourceText = nullptr;
+    PicocParseTokens(pc, FileName, Source, Tokens, RunIt, EnableDebugger, DebuggerCallback);
 
-        NewCleanupNode->Next = pc->CleanupTokenList;
-        pc->CleanupTokenList = NewCleanupNode;
-    }
+    /* clean up */
+    if (CleanupNow)
+        HeapFreeMem(pc, Tokens);
+}
+
+/* lex a whole file without parsing it, so it can be parsed later on, possibly more than once in copies of the
+ * interpreter. the tokens are freed by ParseCleanup() */
+void *PicocLex(Picoc *pc, const char *FileName, const char *Source, int SourceLen, int CleanupSource)
+{
+    void *Tokens = nitwit::lex::LexAnalyse(pc, nitwit::table::TableStrRegister(pc, FileName), Source, SourceLen, nullptr);
+    ParseAddCleanupTokens(pc, Tokens, Source, CleanupSource);
+
+    return Tokens;
+}
+
+/* parse a whole file from the tokens PicocLex() made of it */
+void PicocParseTokens(Picoc *pc, const char *FileName, const char *Source, void *Tokens, int RunIt, int EnableDebugger,
+                      void (*DebuggerCallback)(ParseState*, bool, std::size_t const&))
+{
+    ParseState Parser;
+    ParseResult Ok;
 
     /* initialize the Parser */
-    nitwit::lex::LexInitParser(&Parser, pc, Source, Tokens, RegFileName, RunIt, EnableDebugger, DebuggerCallback);
+    nitwit::lex::LexInitParser(&Parser, pc, Source, Tokens, nitwit::table::TableStrRegister(pc, FileName), RunIt, EnableDebugger, DebuggerCallback);
 
     /* do the parsing */
     do {
@@ -1405,10 +1503,6 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceL
 
     if (Ok == ParseResultError)
         ProgramFail(&Parser, "parse error");
-
-    /* clean up */
-    if (CleanupNow)
-        HeapFreeMem(pc, Tokens);
 }
 
 /* parse interactively */
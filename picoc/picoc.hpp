@@ -31,6 +31,9 @@ namespace nitwit {
     namespace parse {
         void PicocParse(Picoc* pc, const char* FileName, const char* Source, int SourceLen, int RunIt, int CleanupNow,
                 int CleanupSource, int EnableDebugger, void (*DebuggerCallback)(ParseState* state, bool isMultiLineDeclaration, std::size_t const& endLine));
+        void *PicocLex(Picoc* pc, const char* FileName, const char* Source, int SourceLen, int CleanupSource);
+        void PicocParseTokens(Picoc* pc, const char* FileName, const char* Source, void* Tokens, int RunIt, int EnableDebugger,
+                void (*DebuggerCallback)(ParseState* state, bool isMultiLineDeclaration, std::size_t const& endLine));
         void PicocParseInteractive(Picoc* pc);
     }
 }
@@ -32,8 +32,10 @@ void PicocInitialise(Picoc *pc, int StackSize)
 /* free memory */
 void PicocCleanup(Picoc *pc)
 {
-    if (pc->TopStackFrame != nullptr && pc->TopStackFrame != nullptr)
+    if (pc->TopStackFrame != nullptr && pc->TopStackFrame != nullptr) {
         ShadowTableCleanup(pc, &pc->TopStackFrame->LocalTable);
+        delete pc->TopStackFrame->Scopes;
+    }
     DebugCleanup(pc);
 #ifndef NO_HASH_INCLUDE
     IncludeCleanup(pc);
@@ -42,7 +44,6 @@ void PicocCleanup(Picoc *pc)
     nitwit::lex::LexCleanup(pc);
     VariableCleanup(pc);
     TypeCleanup(pc);
-    nitwit::table::TableStrFree(pc);
     HeapCleanup(pc);
     PlatformCleanup(pc);
 }
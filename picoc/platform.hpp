@@ -15,15 +15,22 @@
 #define ALIGN_TYPE double                   /* the default data type to use for alignment */
 #endif
 
-#define GLOBAL_TABLE_SIZE 400                /* global variable table */
-#define STRING_TABLE_SIZE 400                /* shared string table size */
-#define STRING_LITERAL_TABLE_SIZE 400        /* string literal table size */
-#define RESERVED_WORD_TABLE_SIZE 400         /* reserved word table size */
+/* the table sizes must be powers of two */
+#define GLOBAL_TABLE_SIZE 1024              /* initial size of global variable table (can expand) */
+#define STRING_TABLE_SIZE 2048              /* initial size of shared string table (can expand) */
+#define STRING_CHUNK_SIZE 16384             /* the shared strings are stored in chunks of this size */
+#define STRING_LITERAL_TABLE_SIZE 256       /* initial size of string literal table (can expand) */
+#define RESERVED_WORD_TABLE_SIZE 128        /* initial size of reserved word table (can expand) */
 #define PARAMETER_MAX 20                    /* maximum number of parameters to a function */
 #define LINEBUFFER_MAX 512                  /* maximum number of characters on a line */
-#define LOCAL_TABLE_SIZE 30                 /* size of local variable table (can expand) */
+#define LOCAL_TABLE_SIZE 16                 /* size of local variable table (can expand) */
 #define STRUCT_TABLE_SIZE 16                /* size of struct/union member table (can expand) */
 #define GOTO_LABELS_TABLE_SIZE 5           /* size of goto labels table */
+#define ASSUMPTION_STACK_SIZE 1048576       /* scratch stack the witness assumptions are evaluated on */
+#define HEAP_CHUNK_SIZE 65536               /* the small heap allocations are carved out of chunks of this size */
+#ifndef GUEST_HEAP_LIMIT
+#define GUEST_HEAP_LIMIT 536870912          /* the most bytes the program may have allocated with malloc() at once */
+#endif
 
 #define INTERACTIVE_PROMPT_START "starting picoc " PICOC_VERSION "\n"
 #define INTERACTIVE_PROMPT_STATEMENT "picoc> "
@@ -43,10 +50,12 @@
 # include <unistd.h>
 # include <stdarg.h>
 # include <setjmp.h>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <vector>
 #include <math.h>
 #define PICOC_MATH_LIBRARY
 //#  define USE_READLINE
@@ -77,6 +86,7 @@ extern jmp_buf ExitBuf;
 #include <iostream>
 #include <map>
 #include <memory>
+#include <vector>
 #include <string>
 
 #  include <math.h>
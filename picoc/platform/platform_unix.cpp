@@ -90,7 +90,7 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser(pc, "can't read file %s\n", FileName);
     
-    ReadText = static_cast<char *>(malloc(FileInfo.st_size + 1));
+    ReadText = static_cast<char *>(HeapAllocMem(pc, FileInfo.st_size + 1));
     if (ReadText == nullptr)
         ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
         
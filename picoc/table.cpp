@@ -1,6 +1,7 @@
 /* picoc hash table module. This hash table code is used for both symbol tables
- * and the shared string table. */
- 
+ * and the shared string table. The tables use open addressing with linear probing,
+ * the entries are kept in the slots and the slots grow with the number of entries. */
+
 #include "interpreter.hpp"
 
 namespace nitwit {
@@ -9,78 +10,255 @@ namespace nitwit {
 /* initialise the shared string system */
 void TableInit(Picoc *pc)
 {
-    TableInitTable(&pc->StringTable, &pc->StringHashTable[0], STRING_TABLE_SIZE, TRUE);
+    TableInitTable(pc, &pc->StringTable, nullptr, STRING_TABLE_SIZE);
     pc->StrEmpty = TableStrRegister(pc, "");
+    pc->StrVerifierAssume = TableStrRegister(pc, "__VERIFIER_assume");
+}
+
+/* the secret of wyhash, whose construction TableHash() follows */
+static const uint64_t TableHashSecret[2] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull };
+
+/* multiply to 128 bits and fold the halves */
+static inline uint64_t TableHashMix(uint64_t A, uint64_t B)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t Product = (__uint128_t)A * B;
+    return (uint64_t)Product ^ (uint64_t)(Product >> 64);
+#else
+    uint64_t ALo = (uint32_t)A, AHi = A >> 32, BLo = (uint32_t)B, BHi = B >> 32;
+    uint64_t LoLo = ALo * BLo, HiLo = AHi * BLo, LoHi = ALo * BHi, HiHi = AHi * BHi;
+    uint64_t Cross = (LoLo >> 32) + (uint32_t)HiLo + LoHi;
+    uint64_t Hi = HiHi + (HiLo >> 32) + (Cross >> 32);
+    uint64_t Lo = (Cross << 32) | (uint32_t)LoLo;
+    return Lo ^ Hi;
+#endif
+}
+
+static inline uint64_t TableHashRead8(const unsigned char *Pos)
+{
+    uint64_t Word;
+    memcpy(&Word, Pos, sizeof(Word));
+    return Word;
+}
+
+static inline uint64_t TableHashRead4(const unsigned char *Pos)
+{
+    uint32_t Word;
+    memcpy(&Word, Pos, sizeof(Word));
+    return Word;
 }
 
-/* hash function for strings */
-static unsigned int TableHash(const char *Key, unsigned Len)
+/* hash function for strings, also used to key the witness cache */
+uint64_t TableHash(const char *Key, unsigned Len)
 {
-    unsigned int Hash = Len;
-    unsigned int Offset;
-    unsigned int Count;
-    
-    for (Count = 0, Offset = 8; Count < Len; Count++, Offset+=7)
+    auto *Pos = reinterpret_cast<const unsigned char *>(Key);
+    uint64_t Seed = TableHashMix(TableHashSecret[0], TableHashSecret[1]);
+    uint64_t A, B;
+
+    if (Len <= 16)
     {
-        if (Offset > sizeof(unsigned int) * 8 - 7)
-            Offset -= sizeof(unsigned int) * 8 - 6;
-            
-        Hash ^= *Key++ << Offset;
+        if (Len >= 4)
+        {
+            unsigned Offset = (Len >> 3) << 2;
+            A = (TableHashRead4(Pos) << 32) | TableHashRead4(Pos + Offset);
+            B = (TableHashRead4(Pos + Len - 4) << 32) | TableHashRead4(Pos + Len - 4 - Offset);
+        }
+        else if (Len > 0)
+        {
+            A = ((uint64_t)Pos[0] << 16) | ((uint64_t)Pos[Len >> 1] << 8) | Pos[Len - 1];
+            B = 0;
+        }
+        else
+            A = B = 0;
     }
-    
-    return Hash;
+    else
+    {
+        unsigned Left = Len;
+        for (; Left > 16; Left -= 16, Pos += 16)
+            Seed = TableHashMix(TableHashRead8(Pos) ^ TableHashSecret[1], TableHashRead8(Pos + 8) ^ Seed);
+
+        A = TableHashRead8(Pos + Left - 16);
+        B = TableHashRead8(Pos + Left - 8);
+    }
+
+    return TableHashMix(TableHashMix(A ^ TableHashSecret[1], B ^ Seed) ^ TableHashSecret[0] ^ Len, TableHashSecret[1]);
+}
+
+/* a hash to keep in an entry, 0 is left for the free slots */
+unsigned int TableEntryHash(unsigned long long Hash)
+{
+    unsigned int EntryHash = static_cast<unsigned int>(Hash ^ (Hash >> 32));
+    return EntryHash != 0 ? EntryHash : 1;
+}
+
+/* shared strings have unique addresses so we don't need to hash them */
+static unsigned int TableKeyHash(const char *Key)
+{
+    return TableEntryHash((uintptr_t)Key);
 }
 
-/* initialise a table */
-void TableInitTable(Table *Tbl, TableEntry **HashTable, unsigned Size, bool OnHeap)
+/* the slot a hash is looked for first */
+static unsigned TableHomeSlot(Table *Tbl, unsigned int Hash)
+{
+    unsigned int Mixed = Hash * 0x9E3779B1u;
+    return (Mixed ^ (Mixed >> 15)) & (Tbl->Size - 1);
+}
+
+/* initialise a table with the given slots, or with slots of its own if HashTable is nullptr. Size must be a power of two */
+void TableInitTable(Picoc *pc, Table *Tbl, TableEntry *HashTable, unsigned Size)
 {
     Tbl->Size = Size;
-    Tbl->OnHeap = OnHeap;
-    Tbl->HashTable = HashTable;
-    memset((void *)HashTable, '\0', sizeof(TableEntry *) * Size);
+    Tbl->Count = 0;
+    Tbl->OnHeap = HashTable == nullptr;
+    Tbl->HashTable = HashTable != nullptr ? HashTable : static_cast<TableEntry *>(HeapAllocMem(pc, sizeof(TableEntry) * Size));
+    if (Tbl->HashTable == nullptr)
+        ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
+
+    memset((void *)Tbl->HashTable, '\0', sizeof(TableEntry) * Size);
+}
+
+/* free the slots of a table if it has its own */
+void TableFree(Picoc *pc, Table *Tbl)
+{
+    if (Tbl->OnHeap)
+        HeapFreeMem(pc, Tbl->HashTable);
+
+    Tbl->HashTable = nullptr;
+    Tbl->Size = 0;
+    Tbl->Count = 0;
+    Tbl->OnHeap = false;
+}
+
+/* double the slots of a table */
+static void TableGrow(Picoc *pc, Table *Tbl)
+{
+    TableEntry *OldHashTable = Tbl->HashTable;
+    unsigned OldSize = Tbl->Size;
+    bool OldOnHeap = Tbl->OnHeap;
+
+    Tbl->Size = OldSize * 2;
+    Tbl->OnHeap = true;
+    Tbl->HashTable = static_cast<TableEntry *>(HeapAllocMem(pc, sizeof(TableEntry) * Tbl->Size));
+    if (Tbl->HashTable == nullptr)
+        ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
+
+    memset((void *)Tbl->HashTable, '\0', sizeof(TableEntry) * Tbl->Size);
+    for (unsigned Count = 0; Count < OldSize; Count++)
+    {
+        if (OldHashTable[Count].Hash == 0)
+            continue;
+
+        unsigned Slot = TableHomeSlot(Tbl, OldHashTable[Count].Hash);
+        while (Tbl->HashTable[Slot].Hash != 0)
+            Slot = (Slot + 1) & (Tbl->Size - 1);
+
+        Tbl->HashTable[Slot] = OldHashTable[Count];
+    }
+
+    if (OldOnHeap)
+        HeapFreeMem(pc, OldHashTable);
+}
+
+/* look for an entry with a hash for which Matches() holds. if there isn't one, AddAt is set to the free slot it can be
+ * added at */
+TableEntry *TableSearchHash(Table *Tbl, unsigned int Hash, int (*Matches)(const TableEntry *, const void *), const void *Key, unsigned *AddAt)
+{
+    unsigned Slot = TableHomeSlot(Tbl, Hash);
+
+    for (; Tbl->HashTable[Slot].Hash != 0; Slot = (Slot + 1) & (Tbl->Size - 1))
+    {
+        if (Tbl->HashTable[Slot].Hash == Hash && Matches(&Tbl->HashTable[Slot], Key))
+            return &Tbl->HashTable[Slot];   /* found */
+    }
+
+    *AddAt = Slot;    /* didn't find it */
+    return nullptr;
+}
+
+/* take the free slot found by TableSearchHash() for a new entry, growing the table first if it's getting full. the
+ * entry is cleared except for its hash */
+TableEntry *TableAdd(Picoc *pc, Table *Tbl, unsigned int Hash, unsigned AddAt)
+{
+    if ((Tbl->Count + 1) * 4 > Tbl->Size * 3)
+    {
+        TableGrow(pc, Tbl);
+
+        AddAt = TableHomeSlot(Tbl, Hash);
+        while (Tbl->HashTable[AddAt].Hash != 0)
+            AddAt = (AddAt + 1) & (Tbl->Size - 1);
+    }
+
+    TableEntry *NewEntry = &Tbl->HashTable[AddAt];
+    memset((void *)NewEntry, '\0', sizeof(TableEntry));
+    NewEntry->Hash = Hash;
+    Tbl->Count++;
+    return NewEntry;
+}
+
+/* free the slot of an entry, moving the entries probed past it back so they can still be found */
+void TableRemove(Table *Tbl, TableEntry *Entry)
+{
+    unsigned Mask = Tbl->Size - 1;
+    unsigned Free = static_cast<unsigned>(Entry - Tbl->HashTable);
+    unsigned Slot = Free;
+
+    for (;;)
+    {
+        Slot = (Slot + 1) & Mask;
+        if (Tbl->HashTable[Slot].Hash == 0)
+            break;
+
+        /* an entry can't move back before the slot it's looked for first */
+        unsigned Home = TableHomeSlot(Tbl, Tbl->HashTable[Slot].Hash);
+        if (((Slot - Home) & Mask) >= ((Slot - Free) & Mask))
+        {
+            Tbl->HashTable[Free] = Tbl->HashTable[Slot];
+            Free = Slot;
+        }
+    }
+
+    memset((void *)&Tbl->HashTable[Free], '\0', sizeof(TableEntry));
+    Tbl->Count--;
 }
 
 /* check a hash table entry for a key */
 TableEntry *TableSearch(Table *Tbl, const char *Key, unsigned *AddAt)
 {
-    TableEntry *Entry;
-    int HashValue = ((unsigned long)Key) % Tbl->Size;   /* shared strings have unique addresses so we don't need to hash them */
-    
-    for (Entry = Tbl->HashTable[HashValue]; Entry != nullptr; Entry = Entry->Next)
+    unsigned int Hash = TableKeyHash(Key);
+    unsigned Slot = TableHomeSlot(Tbl, Hash);
+
+    for (; Tbl->HashTable[Slot].Hash != 0; Slot = (Slot + 1) & (Tbl->Size - 1))
     {
-        if (Entry->p.v.Key == Key)
-            return Entry;   /* found */
+        if (Tbl->HashTable[Slot].p.v.Key == Key)
+            return &Tbl->HashTable[Slot];   /* found */
     }
-    
-    *AddAt = HashValue;    /* didn't find it in the chain */
+
+    *AddAt = Slot;    /* didn't find it */
     return nullptr;
 }
 
-/* set an identifier to a value. returns FALSE if it already exists. 
+/* set an identifier to a value. returns FALSE if it already exists.
  * Key must be a shared string from TableStrRegister() */
 int TableSet(Picoc *pc, Table *Tbl, char *Key, Value *Val, const char *DeclFileName, unsigned DeclLine, unsigned DeclColumn)
 {
     unsigned AddAt;
     TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
-    
+
     if (FoundEntry == nullptr)
     {   /* add it to the table */
-        TableEntry *NewEntry = static_cast<TableEntry *>(VariableAlloc(pc, nullptr, sizeof(TableEntry),
-                                                                              Tbl->OnHeap));
+        TableEntry *NewEntry = TableAdd(pc, Tbl, TableKeyHash(Key), AddAt);
         NewEntry->DeclFileName = DeclFileName;
         NewEntry->DeclLine = DeclLine;
         NewEntry->DeclColumn = DeclColumn;
         NewEntry->p.v.Key = Key;
         NewEntry->p.v.Val = Val;
-        NewEntry->Next = Tbl->HashTable[AddAt];
-        Tbl->HashTable[AddAt] = NewEntry;
         return TRUE;
     }
 
     return FALSE;
 }
 
-/* find a value in a table. returns FALSE if not found. 
+/* find a value in a table. returns FALSE if not found.
  * Key must be a shared string from TableStrRegister() */
 int TableGet(Table *Tbl, const char *Key, Value **Val, const char **DeclFileName, unsigned int *DeclLine, unsigned int *DeclColumn)
 {
@@ -88,16 +266,16 @@ int TableGet(Table *Tbl, const char *Key, Value **Val, const char **DeclFileName
     TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
     if (FoundEntry == nullptr)
         return FALSE;
-    
+
     *Val = FoundEntry->p.v.Val;
-    
+
     if (DeclFileName != nullptr)
     {
         *DeclFileName = FoundEntry->DeclFileName;
         *DeclLine = FoundEntry->DeclLine;
         *DeclColumn = FoundEntry->DeclColumn;
     }
-    
+
     return TRUE;
 }
 
@@ -105,63 +283,70 @@ int TableGet(Table *Tbl, const char *Key, Value **Val, const char **DeclFileName
 /* remove an entry from the table */
 Value *TableDelete(Picoc *pc, Table *Tbl, const char *Key)
 {
-    TableEntry **EntryPtr;
-    int HashValue = ((unsigned long)Key) % Tbl->Size;   /* shared strings have unique addresses so we don't need to hash them */
-    
-    for (EntryPtr = &Tbl->HashTable[HashValue]; *EntryPtr != nullptr; EntryPtr = &(*EntryPtr)->Next)
-    {
-        if ((*EntryPtr)->p.v.Key == Key)
-        {
-            TableEntry *DeleteEntry = *EntryPtr;
-            Value *Val = DeleteEntry->p.v.Val;
-            *EntryPtr = DeleteEntry->Next;
-            HeapFreeMem(pc, DeleteEntry);
-
-            return Val;
-        }
-    }
+    unsigned AddAt;
+    TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
+    if (FoundEntry == nullptr)
+        return nullptr;
 
-    return nullptr;
+    Value *Val = FoundEntry->p.v.Val;
+    TableRemove(Tbl, FoundEntry);
+    return Val;
 }
 
-/* check a hash table entry for an identifier */
-static TableEntry *TableSearchIdentifier(Table *Tbl, const char *Key, unsigned Len, unsigned *AddAt)
+/* copy a string into the chunks the shared strings are kept in, so it keeps its address when the table grows. the
+ * strings start at even addresses, as the lowest bit of a key hides variables which are out of scope */
+static char *TableStrStore(Picoc *pc, const char *Str, unsigned Len)
 {
-    TableEntry *Entry;
-    int HashValue = TableHash(Key, Len) % Tbl->Size;
-    
-    for (Entry = Tbl->HashTable[HashValue]; Entry != nullptr; Entry = Entry->Next)
+    struct StringChunk *Chunk = pc->StringChunks;
+    unsigned StoreLen = (Len + 2) & ~1u;
+
+    if (Chunk == nullptr || Chunk->Size - Chunk->Used < StoreLen)
     {
-        if (strncmp(&Entry->p.Key[0], (char *)Key, Len) == 0 && Entry->p.Key[Len] == '\0')
-            return Entry;   /* found */
+        unsigned Size = StoreLen > STRING_CHUNK_SIZE ? StoreLen : STRING_CHUNK_SIZE;
+        Chunk = static_cast<struct StringChunk *>(HeapAllocMem(pc, sizeof(struct StringChunk) + Size));
+        if (Chunk == nullptr)
+            ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
+
+        Chunk->Size = Size;
+        Chunk->Used = 0;
+        if (pc->StringChunks != nullptr && Size > STRING_CHUNK_SIZE)
+        {
+            /* keep filling the current chunk after a big string */
+            Chunk->Next = pc->StringChunks->Next;
+            pc->StringChunks->Next = Chunk;
+        }
+        else
+        {
+            Chunk->Next = pc->StringChunks;
+            pc->StringChunks = Chunk;
+        }
     }
-    
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return nullptr;
+
+    char *NewStr = (char *)(Chunk + 1) + Chunk->Used;
+    memcpy(NewStr, Str, Len);
+    NewStr[Len] = '\0';
+    Chunk->Used += StoreLen;
+    return NewStr;
 }
 
 /* set an identifier and return the identifier. share if possible */
 char *TableSetIdentifier(Picoc *pc, Table *Tbl, const char *Ident, unsigned IdentLen)
 {
-    unsigned AddAt;
-    TableEntry *FoundEntry = TableSearchIdentifier(Tbl, Ident, IdentLen, &AddAt);
-    
-    if (FoundEntry != nullptr)
-        return &FoundEntry->p.Key[0];
-    else
-    {   /* add it to the table - we economise by not allocating the whole structure here */
-        auto *NewEntry = static_cast<TableEntry *>(HeapAllocMem(pc, sizeof(TableEntry) -
-                                                                                 sizeof(TableEntry::TableEntryPayload) +
-                                                                                 IdentLen + 1));
-        if (NewEntry == nullptr)
-            ProgramFailNoParserWithExitCode(pc, 251, "Out of memory");
-            
-        strncpy((char *)&NewEntry->p.Key[0], (char *)Ident, IdentLen);
-        NewEntry->p.Key[IdentLen] = '\0';
-        NewEntry->Next = Tbl->HashTable[AddAt];
-        Tbl->HashTable[AddAt] = NewEntry;
-        return &NewEntry->p.Key[0];
+    unsigned int Hash = TableEntryHash(TableHash(Ident, IdentLen));
+    unsigned Slot = TableHomeSlot(Tbl, Hash);
+
+    /* the stored hash and length rule out nearly every other string before its characters are compared */
+    for (; Tbl->HashTable[Slot].Hash != 0; Slot = (Slot + 1) & (Tbl->Size - 1))
+    {
+        TableEntry *Entry = &Tbl->HashTable[Slot];
+        if (Entry->Hash == Hash && Entry->p.s.Len == IdentLen && memcmp(Entry->p.s.Key, Ident, IdentLen) == 0)
+            return Entry->p.s.Key;
     }
+
+    TableEntry *NewEntry = TableAdd(pc, Tbl, Hash, Slot);
+    NewEntry->p.s.Key = TableStrStore(pc, Ident, IdentLen);
+    NewEntry->p.s.Len = IdentLen;
+    return NewEntry->p.s.Key;
 }
 
 /* register a string in the shared string store */
@@ -174,23 +359,5 @@ char *TableStrRegister(Picoc *pc, const char *Str, unsigned Len)
     return TableSetIdentifier(pc, &pc->StringTable, Str, Len);
 }
 
-/* free all the strings */
-void TableStrFree(Picoc *pc)
-{
-    TableEntry *Entry;
-    TableEntry *NextEntry;
-    int Count;
-    
-    for (Count = 0; Count < pc->StringTable.Size; Count++)
-    {
-        for (Entry = pc->StringTable.HashTable[Count]; Entry != nullptr; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            HeapFreeMem(pc, Entry);
-        }
-    }
-}
-
-
     }
 }
@@ -16,64 +16,32 @@ static int IntAlignBytes;
  * change to d (0) when element is initiliazed (assigned)
  **/
 void initNonDetList (ParseState * Parser, ValueType * Type, int ArraySize) {
-    NonDetList * head = static_cast<NonDetList *>(VariableAlloc(Parser->pc, Parser, sizeof(NonDetList), TRUE));
-    head->IsNonDet = true;
-
-    NonDetList * temp = head;
-    for (int i = 1; i < ArraySize; ++i) {
-        NonDetList * tail = static_cast<NonDetList *>(VariableAlloc(Parser->pc, Parser, sizeof(NonDetList), TRUE));
-        tail->IsNonDet = true;
-        tail->Next = nullptr;
-        temp->Next = tail;
-        temp = temp->Next;
-    }
+    int Words = ArraySize > 0 ? (ArraySize + NON_DET_WORD_BITS - 1) / NON_DET_WORD_BITS : 1;
+    NonDetWord * list = static_cast<NonDetWord *>(VariableAlloc(Parser->pc, Parser, Words * sizeof(NonDetWord), TRUE));
+    memset((void *)list, 0xff, Words * sizeof(NonDetWord));
 
-    Type->NDList = head;
+    Type->NDList = list;
     Type->NDListSize = ArraySize;
 }
 
-void freeNonDetList(Picoc* pc, NonDetList* list) {
-    if (list != nullptr) {
-        NonDetList* next = list->Next;
-        HeapFreeMem(pc, list);
-        freeNonDetList(pc, next);
-    }
-}
-
-void freeNonDetList(Picoc* pc, ValueType* Type) {
-    freeNonDetList(pc, Type->NDList);
-}
-
-bool getNonDetListElement(NonDetList * List, int ArrayIndex) {
-    if (List == nullptr) {
+bool getNonDetListElement(NonDetWord * List, int ArrayIndex) {
+    if (List == nullptr || ArrayIndex < 0) {
         std::cerr << "Internal Error: Access to NonDetList that is null!" << std::endl;
         return false;
     }
-    struct NonDetList * current = List;
-    for (int i=0; i<ArrayIndex; ++i) {
-        current = current->Next;
-        if (current == nullptr) {
-            std::cerr << "Internal Error: Access to NonDetList that is null!" << std::endl;
-            return false;
-        }
-    }
-    return current->IsNonDet;
+    return (List[ArrayIndex / NON_DET_WORD_BITS] >> (ArrayIndex % NON_DET_WORD_BITS)) & 1;
 }
 
-void setNonDetListElement(NonDetList * List, int ArrayIndex, bool nonDet) {
-    if (List == nullptr) {
+void setNonDetListElement(NonDetWord * List, int ArrayIndex, bool nonDet) {
+    if (List == nullptr || ArrayIndex < 0) {
         std::cerr << "Internal Error: Access to NonDetList that is null!" << std::endl;
         return;
     }
-    struct NonDetList * current = List;
-    for (int i = 0; i < ArrayIndex; ++i) {
-        current = current->Next;
-        if (current == nullptr) {
-            std::cerr << "Internal Error: Access to NonDetList that is null!" << std::endl;
-            return;
-        }
-    }
-    current->IsNonDet = nonDet;
+    NonDetWord Bit = (NonDetWord)1 << (ArrayIndex % NON_DET_WORD_BITS);
+    if (nonDet)
+        List[ArrayIndex / NON_DET_WORD_BITS] |= Bit;
+    else
+        List[ArrayIndex / NON_DET_WORD_BITS] &= ~Bit;
 }
 
 bool TypeIsNonDeterministic(struct ValueType *Typ) {
@@ -327,69 +295,16 @@ void TypeInit(Picoc *pc)
     pc->VoidPtrType = TypeAdd(pc, nullptr, &pc->VoidType, BaseType::TypePointer, 0, pc->StrEmpty, sizeof(void *), PointerAlignBytes);
 }
 
-/* deallocate heap-allocated types */
+/* deallocate what the heap-allocated types own outside of the heap. the types, their non-determinism lists and member
+ * tables are released with the rest of the heap by HeapCleanup() */
 void TypeCleanupNode(Picoc *pc, struct ValueType *Typ) {
     struct ValueType *SubType;
-    struct ValueType *NextSubType;
-
-    if (Typ != nullptr)
-        SubType = Typ->DerivedTypeList;
-    else
-        SubType = nullptr;
-
-    if (Typ != nullptr) {
-        freeNonDetList(pc, Typ->NDList);
-    }
-
-    // special case substruct element
-    if (SubType != nullptr && (SubType->Next != nullptr && SubType->Next->Base == BaseType::TypeStruct)) {
-
-        //SubType = SubType->Next;
-        for (SubType = SubType->Next; SubType != nullptr; SubType = NextSubType) {
-            NextSubType = SubType->Next;
-            TypeCleanupNode(pc, SubType);
-            if (SubType->OnHeap) {
-                /* if it's a struct or union deallocate all the member values */
-                if (SubType->Members != nullptr) {
-                    VariableTableCleanup(pc, SubType->Members);
-                    HeapFreeMem(pc, SubType->Members);
-                    delete SubType->MemberOrder;
-                }
-
-                /* free this node */
-                HeapFreeMem(pc, SubType);
-            }
-        }
-
-        // clean highest SubType; lower members are already freed
-        SubType = Typ->DerivedTypeList;
 
+    for (SubType = Typ->DerivedTypeList; SubType != nullptr; SubType = SubType->Next) {
         TypeCleanupNode(pc, SubType);
-        if (SubType->OnHeap) {
-            /* free all member references */
-            if (SubType->Members != nullptr) {
-                HeapFreeMem(pc, SubType->Members);
-                delete SubType->MemberOrder;
-            }
-
-            /* free this node */
-            HeapFreeMem(pc, SubType);
-        }
-    } else {
-        for (SubType = Typ->DerivedTypeList; SubType != nullptr; SubType = NextSubType) {
-            NextSubType = SubType->Next;
-            TypeCleanupNode(pc, SubType);
-            if (SubType->OnHeap) {
-                /* if it's a struct or union deallocate all the member values */
-                if (SubType->Members != nullptr) {
-                    VariableTableCleanup(pc, SubType->Members);
-                    HeapFreeMem(pc, SubType->Members);
-                    delete SubType->MemberOrder;
-                }
-
-                /* free this node */
-                HeapFreeMem(pc, SubType);
-            }
+        if (SubType->OnHeap && SubType->Members != nullptr) {
+            VariableTableCleanup(pc, SubType->Members);
+            delete SubType->MemberOrder;
         }
     }
 }
@@ -465,8 +380,7 @@ void TypeParseStruct(struct ParseState *Parser, struct ValueType **Typ, int IsSt
     (*Typ)->Members = static_cast<Table *>(VariableAlloc(pc, Parser, sizeof(struct Table) +
                                                                      STRUCT_TABLE_SIZE * sizeof(struct TableEntry),
                                                          TRUE));
-    (*Typ)->Members->HashTable = (struct TableEntry **)((char *)(*Typ)->Members + sizeof(struct Table));
-    nitwit::table::TableInitTable((*Typ)->Members, (struct TableEntry **)((char *)(*Typ)->Members + sizeof(struct Table)), STRUCT_TABLE_SIZE, true);
+    nitwit::table::TableInitTable(pc, (*Typ)->Members, (struct TableEntry *)((char *)(*Typ)->Members + sizeof(struct Table)), STRUCT_TABLE_SIZE);
 
     // do the parsing of members if not zero element struct
     if(!NO_ZERO_STRUCT && !ZeroTypeStruct) {
@@ -573,8 +487,7 @@ struct ValueType *TypeCreateOpaqueStruct(Picoc *pc, struct ParseState *Parser, c
     /* create the (empty) table */
     Typ->Members = static_cast<Table *>(VariableAlloc(pc, Parser, sizeof(struct Table) +
                                                                   STRUCT_TABLE_SIZE * sizeof(struct TableEntry), TRUE));
-    Typ->Members->HashTable = (struct TableEntry **)((char *)Typ->Members + sizeof(struct Table));
-    nitwit::table::TableInitTable(Typ->Members, (struct TableEntry **)((char *)Typ->Members + sizeof(struct Table)), STRUCT_TABLE_SIZE, true);
+    nitwit::table::TableInitTable(pc, Typ->Members, (struct TableEntry *)((char *)Typ->Members + sizeof(struct Table)), STRUCT_TABLE_SIZE);
     Typ->Sizeof = Size;
     
     return Typ;
@@ -12,17 +12,21 @@
 /* initialise the variable system */
 void VariableInit(Picoc *pc)
 {
-    nitwit::table::TableInitTable(&(pc->GlobalTable), &(pc->GlobalHashTable)[0], GLOBAL_TABLE_SIZE, true);
-    nitwit::table::TableInitTable(&pc->StringLiteralTable, &pc->StringLiteralHashTable[0], STRING_LITERAL_TABLE_SIZE, true);
+    nitwit::table::TableInitTable(pc, &pc->GlobalTable, nullptr, GLOBAL_TABLE_SIZE);
+    nitwit::table::TableInitTable(pc, &pc->StringLiteralTable, nullptr, STRING_LITERAL_TABLE_SIZE);
     pc->TopStackFrame = nullptr;
+    pc->ScopeIDs = new ScopeNumbering();
 }
 
 /* deallocate the contents of a variable */
 void VariableFree(Picoc* pc, Value* Val) {
     if (Val->ValOnHeap || Val->AnyValOnHeap) {
         /* free function bodies, don't free function ptrs bodies  */
-        if (Val->Typ == &pc->FunctionType && Val->Val->FuncDef.Intrinsic == nullptr && Val->Val->FuncDef.Body.Pos != nullptr)
+        if (Val->Typ == &pc->FunctionType && Val->Val->FuncDef.Intrinsic == nullptr && Val->Val->FuncDef.Body.Pos != nullptr) {
             HeapFreeMem(pc, (void *)Val->Val->FuncDef.Body.Pos);
+            delete Val->Val->FuncDef.Body.GotoLabels;
+            delete Val->Val->FuncDef.Body.SwitchTables;
+        }
 
         /* free macro bodies */
         if (Val->Typ == &pc->MacroType)
@@ -47,23 +51,22 @@ void VariableFree(Picoc* pc, Value* Val) {
     }
 }
 
-/* deallocate the global table and the string literal table */
+/* deallocate what a table's values own outside of the heap. the values and the slots themselves are released with the
+ * rest of the heap by HeapCleanup() */
 void VariableTableCleanup(Picoc *pc, struct Table *HashTable)
 {
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    int Count;
+    unsigned Count;
+    Value *Val;
 
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != nullptr; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            VariableFree(pc, Entry->p.v.Val);
-//            delete Entry->p.v.ValShadows;
+        if (HashTable->HashTable[Count].Hash == 0)
+            continue;
 
-            /* free the hash table entry */
-            HeapFreeMem(pc, Entry);
+        Val = HashTable->HashTable[Count].p.v.Val;
+        if (Val->Typ == &pc->FunctionType && Val->Val->FuncDef.Intrinsic == nullptr && Val->Val->FuncDef.Body.Pos != nullptr) {
+            delete Val->Val->FuncDef.Body.GotoLabels;
+            delete Val->Val->FuncDef.Body.SwitchTables;
         }
     }
 }
@@ -71,17 +74,12 @@ void VariableTableCleanup(Picoc *pc, struct Table *HashTable)
 /* deallocate the global table and the string literal table */
 void ShadowTableCleanup(Picoc *pc, struct Table *HashTable)
 {
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    int Count;
+    unsigned Count;
 
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != nullptr; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            delete Entry->p.v.ValShadows;
-        }
+        if (HashTable->HashTable[Count].Hash != 0)
+            delete HashTable->HashTable[Count].p.v.ValShadows;
     }
 }
 
@@ -89,6 +87,7 @@ void VariableCleanup(Picoc *pc)
 {
     VariableTableCleanup(pc, &pc->GlobalTable);
     VariableTableCleanup(pc, &pc->StringLiteralTable);
+    delete pc->ScopeIDs;
 }
 
 /* allocate some memory, either on the heap or the stack and check if we've run out */
@@ -230,48 +229,126 @@ void VariableRealloc(struct ParseState *Parser, Value *FromValue, int NewSize)
     FromValue->AnyValOnHeap = TRUE;
 }
 
+/* bring a variable of a block scope back into scope, or its shadow if it has one there */
+static void VariableScopeEnterEntry(struct TableEntry *Entry, int ScopeID)
+{
+    if (Entry->p.v.Val->ScopeID != ScopeID && Entry->p.v.ValShadows != nullptr){ // todo is shadows always initiated?
+        auto shadow = Entry->p.v.ValShadows->shadows.find(ScopeID);
+        if (shadow != Entry->p.v.ValShadows->shadows.end()){
+            shadow->second->ShadowedVal = Entry->p.v.Val; // save which value was shadowed
+            Entry->p.v.Val = shadow->second; // take the shadow as the current value
+            Entry->p.v.Val->OutOfScope = FALSE;
+        #ifdef VAR_SCOPE_DEBUG
+            printf(">>> shadow back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+        #endif
+        }
+    } else if (Entry->p.v.Val->ScopeID == ScopeID && Entry->p.v.Val->OutOfScope) {
+        Entry->p.v.Val->OutOfScope = FALSE;
+        Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
+        #ifdef VAR_SCOPE_DEBUG
+        printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+        #endif
+    }
+}
+
+/* take a variable of a block scope out of scope, bringing back the value it shadowed if any */
+static void VariableScopeLeaveEntry(struct TableEntry *Entry, int ScopeID)
+{
+    if (Entry->p.v.Val->ScopeID == ScopeID && !Entry->p.v.Val->OutOfScope)
+    {
+        #ifdef VAR_SCOPE_DEBUG
+        printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+        #endif
+        Entry->p.v.Val->OutOfScope = TRUE;
+        if (Entry->p.v.Val->ShadowedVal == nullptr){
+            Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
+        } else {
+            Value * shadow = Entry->p.v.Val;
+            Entry->p.v.Val = shadow->ShadowedVal;
+            shadow->ShadowedVal = nullptr;
+#ifdef VAR_SCOPE_DEBUG
+            printf(">>> shadowed variable back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+#endif
+        }
+    }
+}
+
+/* the block scopes of the top stack frame's local table entries, recorded again from the entries if the table grew
+ * since they were recorded */
+static ScopeEntries *VariableScopeEntries(Picoc *pc)
+{
+    struct StackFrame *Frame = pc->TopStackFrame;
+    struct Table *LocalTable = &Frame->LocalTable;
+
+    if (Frame->Scopes != nullptr && Frame->Scopes->recordedTableSize() != LocalTable->Size)
+    {
+        delete Frame->Scopes;
+        Frame->Scopes = new ScopeEntries(LocalTable->Size);
+        for (unsigned Slot = 0; Slot < LocalTable->Size; Slot++)
+        {
+            struct TableEntry *Entry = &LocalTable->HashTable[Slot];
+            if (Entry->Hash == 0)
+                continue;
+
+            /* an entry was recorded in the scope it was defined in and in each scope it was shadowed in */
+            if (Entry->p.v.Val->ScopeID != -1)
+                Frame->Scopes->add(Entry->p.v.Val->ScopeID, Slot);
+
+            if (Entry->p.v.ValShadows != nullptr)
+            {
+                for (auto const& Shadow : Entry->p.v.ValShadows->shadows)
+                {
+                    if (Shadow.first != -1)
+                        Frame->Scopes->add(Shadow.first, Slot);
+                }
+            }
+        }
+    }
+
+    return Frame->Scopes;
+}
+
+/* remember that a local table entry was given a value in a block scope, so only its entries are visited when the
+ * scope is entered or left */
+static void VariableScopeRecord(Picoc *pc, struct TableEntry *Entry, int ScopeID)
+{
+    if (pc->TopStackFrame == nullptr || Entry == nullptr || ScopeID == -1)
+        return;
+
+    if (pc->TopStackFrame->Scopes == nullptr)
+        pc->TopStackFrame->Scopes = new ScopeEntries(pc->TopStackFrame->LocalTable.Size);
+
+    VariableScopeEntries(pc)->add(ScopeID, static_cast<unsigned>(Entry - pc->TopStackFrame->LocalTable.HashTable));
+}
+
 int VariableScopeBegin(struct ParseState * Parser, int* OldScopeID)
 {
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
     Picoc * pc = Parser->pc;
-    int Count;
-    #ifdef VAR_SCOPE_DEBUG
-    int FirstPrint = 0;
-    #endif
-    
-    struct Table * HashTable = (pc->TopStackFrame == nullptr) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
+    unsigned Count;
 
     if (Parser->ScopeID == -1) return -1;
 
-    /* XXX dumb hash, let's hope for no collisions... */
     *OldScopeID = Parser->ScopeID;
-    Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) * ((int)(intptr_t)(Parser->Pos) / sizeof(char*));
-    /* or maybe a more human-readable hash for debugging? */
-    /* Parser->ScopeID = Parser->Line * 0x10000 + Parser->CharacterPos; */
-    
-    for (Count = 0; Count < HashTable->Size; Count++)
+    Parser->ScopeID = pc->ScopeIDs->get(Parser->Pos);
+
+    if (pc->TopStackFrame == nullptr)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != nullptr; Entry = NextEntry)
+        /* top level blocks are rare, just look through all the globals */
+        for (Count = 0; Count < pc->GlobalTable.Size; Count++)
         {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID != Parser->ScopeID && Entry->p.v.ValShadows != nullptr){ // todo is shadows always initiated?
-                auto shadow = Entry->p.v.ValShadows->shadows.find(Parser->ScopeID);
-                if (shadow != Entry->p.v.ValShadows->shadows.end()){
-                    shadow->second->ShadowedVal = Entry->p.v.Val; // save which value was shadowed
-                    Entry->p.v.Val = shadow->second; // take the shadow as the current value
-                    Entry->p.v.Val->OutOfScope = FALSE;
-                #ifdef VAR_SCOPE_DEBUG
-                    printf(">>> shadow back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-                }
-            } else if (Entry->p.v.Val->ScopeID == Parser->ScopeID && Entry->p.v.Val->OutOfScope) {
-                Entry->p.v.Val->OutOfScope = FALSE;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
-                #ifdef VAR_SCOPE_DEBUG
-                printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-            }
+            Entry = &pc->GlobalTable.HashTable[Count];
+            if (Entry->Hash != 0)
+                VariableScopeEnterEntry(Entry, Parser->ScopeID);
+        }
+    }
+    else if (pc->TopStackFrame->Scopes != nullptr)
+    {
+        auto Entries = VariableScopeEntries(pc)->find(Parser->ScopeID);
+        if (Entries != nullptr)
+        {
+            for (unsigned Slot: *Entries)
+                VariableScopeEnterEntry(&pc->TopStackFrame->LocalTable.HashTable[Slot], Parser->ScopeID);
         }
     }
 
@@ -281,39 +358,27 @@ int VariableScopeBegin(struct ParseState * Parser, int* OldScopeID)
 void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int PrevScopeID)
 {
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
     Picoc * pc = Parser->pc;
-    int Count;
-    #ifdef VAR_SCOPE_DEBUG
-    int FirstPrint = 0;
-    #endif
-
-    struct Table * HashTable = (pc->TopStackFrame == nullptr) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
+    unsigned Count;
 
     if (ScopeID == -1) return;
 
-    for (Count = 0; Count < HashTable->Size; Count++)
+    if (pc->TopStackFrame == nullptr)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != nullptr; Entry = NextEntry)
+        for (Count = 0; Count < pc->GlobalTable.Size; Count++)
         {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID == ScopeID && !Entry->p.v.Val->OutOfScope)
-            {
-                #ifdef VAR_SCOPE_DEBUG
-                printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-                Entry->p.v.Val->OutOfScope = TRUE;
-                if (Entry->p.v.Val->ShadowedVal == nullptr){
-                    Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
-                } else {
-                    Value * shadow = Entry->p.v.Val;
-                    Entry->p.v.Val = shadow->ShadowedVal;
-                    shadow->ShadowedVal = nullptr;
-#ifdef VAR_SCOPE_DEBUG
-                    printf(">>> shadowed variable back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-#endif
-                }
-            }
+            Entry = &pc->GlobalTable.HashTable[Count];
+            if (Entry->Hash != 0)
+                VariableScopeLeaveEntry(Entry, ScopeID);
+        }
+    }
+    else if (pc->TopStackFrame->Scopes != nullptr)
+    {
+        auto Entries = VariableScopeEntries(pc)->find(ScopeID);
+        if (Entries != nullptr)
+        {
+            for (unsigned Slot: *Entries)
+                VariableScopeLeaveEntry(&pc->TopStackFrame->LocalTable.HashTable[Slot], ScopeID);
         }
     }
 
@@ -323,16 +388,14 @@ void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int PrevScopeID)
 int VariableDefinedAndOutOfScope(Picoc * pc, const char* Ident)
 {
     struct TableEntry *Entry;
-    int Count;
+    unsigned Count;
 
     struct Table * HashTable = (pc->TopStackFrame == nullptr) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != nullptr; Entry = Entry->Next)
-        {
-            if (Entry->p.v.Val->OutOfScope && (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
-                return TRUE;
-        }
+        Entry = &HashTable->HashTable[Count];
+        if (Entry->Hash != 0 && Entry->p.v.Val->OutOfScope && (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
+            return TRUE;
     }
     return FALSE;
 }
@@ -360,8 +423,9 @@ VariableDefine(Picoc *pc, ParseState *Parser, char *Ident, Value *InitValue, Val
     AssignValue->ScopeID = ScopeID;
     AssignValue->OutOfScope = FALSE;
 
+    unsigned AddAt;
     if (!nitwit::table::TableSet(pc, currentTable, Ident, AssignValue, Parser ? ((char *)Parser->FileName) : nullptr, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0)){
-        unsigned AddAt; TableEntry * FoundEntry = nitwit::table::TableSearch(currentTable, Ident, &AddAt);
+        TableEntry * FoundEntry = nitwit::table::TableSearch(currentTable, Ident, &AddAt);
         if (MakeShadow) {
             // shadowing
             if (pc->TopStackFrame == nullptr) {
@@ -377,12 +441,15 @@ VariableDefine(Picoc *pc, ParseState *Parser, char *Ident, Value *InitValue, Val
             FoundEntry->p.v.ValShadows->shadows.emplace(std::make_pair(ScopeID, AssignValue));
             AssignValue->ShadowedVal = FoundEntry->p.v.Val;
             FoundEntry->p.v.Val = AssignValue;
+            VariableScopeRecord(pc, FoundEntry, ScopeID);
     #ifdef VAR_SCOPE_DEBUG
             printf(">>> shadow the variable %s\n", Ident);
     #endif
         } else {
             ProgramFailWithExitCode(Parser, 246, "Variable '%s' is already defined", Ident);
         }
+    } else {
+        VariableScopeRecord(pc, nitwit::table::TableSearch(currentTable, Ident, &AddAt), ScopeID);
     }
 
     return AssignValue;
@@ -461,11 +528,23 @@ Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *Ident,
 int VariableDefined(Picoc *pc, const char *Ident)
 {
     Value *FoundValue;
-    
-    if (pc->TopStackFrame == nullptr || !nitwit::table::TableGet(&pc->TopStackFrame->LocalTable, Ident, &FoundValue, nullptr, nullptr, nullptr))
+
+    return VariableLookup(pc, Ident, &FoundValue);
+}
+
+/* get the value of a variable if it is defined, in one lookup instead of VariableDefined() followed
+ * by VariableGet(). Ident must be registered */
+int VariableLookup(Picoc *pc, const char *Ident, Value **LVal)
+{
+    if (pc->TopStackFrame == nullptr || !nitwit::table::TableGet(&pc->TopStackFrame->LocalTable, Ident, LVal, nullptr, nullptr, nullptr))
     {
-        if (!nitwit::table::TableGet(&pc->GlobalTable, Ident, &FoundValue, nullptr, nullptr, nullptr))
+        if (!nitwit::table::TableGet(&pc->GlobalTable, Ident, LVal, nullptr, nullptr, nullptr))
             return FALSE;
+
+#ifdef LAZY_LIBRARY
+        if ((*LVal)->Typ == &pc->FunctionType && (*LVal)->Val->FuncDef.LazyFunction != nullptr)
+            LibraryBind(pc, Ident, LVal);
+#endif
     }
 
     return TRUE;
@@ -487,6 +566,11 @@ void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, Value
                 else ProgramFailNoParserWithExitCode(pc, 244, "'%s' is undefined", Ident);
             }
         }
+
+#ifdef LAZY_LIBRARY
+        if ((*LVal)->Typ == &pc->FunctionType && (*LVal)->Val->FuncDef.LazyFunction != nullptr)
+            LibraryBind(pc, Ident, LVal);
+#endif
     }
 }
 
@@ -501,9 +585,15 @@ Value* VariableDefinePlatformVar(Picoc *pc, struct ParseState *Parser, const cha
     std::cout << "Debug: Registered PlatformVar = " << (void*)SomeValue << " with Val->Val = " << (void*)SomeValue->Val << " of size " << 0 << " in VariableDefinePlatformVar with IsLValue = " << IsWritable << ", OnHeap = " << 1 << "." << std::endl;
 #endif
     
-    if (!nitwit::table::TableSet(pc, (pc->TopStackFrame == nullptr) ? &pc->GlobalTable : &pc->TopStackFrame->LocalTable, nitwit::table::TableStrRegister(pc, Ident), SomeValue, Parser ? Parser->FileName : nullptr, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
+    char *RegisteredIdent = nitwit::table::TableStrRegister(pc, Ident);
+    if (!nitwit::table::TableSet(pc, (pc->TopStackFrame == nullptr) ? &pc->GlobalTable : &pc->TopStackFrame->LocalTable, RegisteredIdent, SomeValue, Parser ? Parser->FileName : nullptr, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
         ProgramFailWithExitCode(Parser, 246, "'%s' is already defined", Ident);
 
+    if (Parser != nullptr && pc->TopStackFrame != nullptr) {
+        unsigned AddAt;
+        VariableScopeRecord(pc, nitwit::table::TableSearch(&pc->TopStackFrame->LocalTable, RegisteredIdent, &AddAt), SomeValue->ScopeID);
+    }
+
     return SomeValue;
 }
 
@@ -552,7 +642,8 @@ void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName, int
     NewFrame->FuncName = FuncName;
     NewFrame->Parameter = static_cast<Value **>((NumParams > 0) ? ((void *) ((char *) NewFrame +
                                                                              sizeof(struct StackFrame))) : nullptr);
-    nitwit::table::TableInitTable(&NewFrame->LocalTable, &NewFrame->LocalHashTable[0], LOCAL_TABLE_SIZE, false);
+    nitwit::table::TableInitTable(Parser->pc, &NewFrame->LocalTable, &NewFrame->LocalHashTable[0], LOCAL_TABLE_SIZE);
+    NewFrame->Scopes = nullptr;
     NewFrame->PreviousStackFrame = Parser->pc->TopStackFrame;
     Parser->pc->TopStackFrame = NewFrame;
 }
@@ -565,6 +656,8 @@ void VariableStackFramePop(struct ParseState *Parser)
         
     nitwit::parse::ParserCopy(Parser, &Parser->pc->TopStackFrame->ReturnParser);
     ShadowTableCleanup(Parser->pc, &Parser->pc->TopStackFrame->LocalTable);
+    nitwit::table::TableFree(Parser->pc, &Parser->pc->TopStackFrame->LocalTable);
+    delete Parser->pc->TopStackFrame->Scopes;
     Parser->pc->TopStackFrame = Parser->pc->TopStackFrame->PreviousStackFrame;
     HeapPopStackFrame(Parser->pc);
 }
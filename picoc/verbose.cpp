@@ -8,8 +8,9 @@ void cw_verbose(std::string const& Format, ...) {}
 
 void printTable(struct Table* Tbl) {
     struct TableEntry* Entry;
-    for (short i = 0; i < Tbl->Size; ++i) {
-        for (Entry = Tbl->HashTable[i]; Entry != nullptr; Entry = Entry->Next)
+    for (unsigned i = 0; i < Tbl->Size; ++i) {
+        Entry = &Tbl->HashTable[i];
+        if (Entry->Hash != 0)
         {
             if (IS_FP(Entry->p.v.Val)) {
                 double fp = CoerceT<double>(Entry->p.v.Val);
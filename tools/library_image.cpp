@@ -0,0 +1,234 @@
+// Writes the library image that LibraryAdd() defines the library functions from: every prototype of the built-in
+// libraries, parsed the same way LibraryAdd() would parse it at startup.
+//
+// Usage: nitwit_library_image LibraryImage.cpp
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "picoc/picoc.hpp"
+
+#undef min
+
+struct BaseTypeMember {
+	const char *name;
+	ValueType Picoc::*member;
+};
+
+const BaseTypeMember base_type_members[] = {
+		{"IntType", &Picoc::IntType},
+		{"ShortType", &Picoc::ShortType},
+		{"CharType", &Picoc::CharType},
+		{"LongType", &Picoc::LongType},
+		{"LongLongType", &Picoc::LongLongType},
+		{"UnsignedIntType", &Picoc::UnsignedIntType},
+		{"UnsignedShortType", &Picoc::UnsignedShortType},
+		{"UnsignedLongType", &Picoc::UnsignedLongType},
+		{"UnsignedLongLongType", &Picoc::UnsignedLongLongType},
+		{"UnsignedCharType", &Picoc::UnsignedCharType},
+		{"DoubleType", &Picoc::DoubleType},
+		{"FloatType", &Picoc::FloatType},
+		{"VoidType", &Picoc::VoidType},
+		{"TypeType", &Picoc::TypeType},
+		{"FunctionType", &Picoc::FunctionType},
+		{"MacroType", &Picoc::MacroType},
+		{"EnumType", &Picoc::EnumType},
+		{"StructType", &Picoc::StructType},
+		{"GotoLabelType", &Picoc::GotoLabelType},
+		{"FunctionPtrType", &Picoc::FunctionPtrType},
+		{"IntNDType", &Picoc::IntNDType},
+		{"ShortNDType", &Picoc::ShortNDType},
+		{"CharNDType", &Picoc::CharNDType},
+		{"LongNDType", &Picoc::LongNDType},
+		{"LongLongNDType", &Picoc::LongLongNDType},
+		{"UnsignedIntNDType", &Picoc::UnsignedIntNDType},
+		{"UnsignedShortNDType", &Picoc::UnsignedShortNDType},
+		{"UnsignedCharNDType", &Picoc::UnsignedCharNDType},
+		{"UnsignedLongNDType", &Picoc::UnsignedLongNDType},
+		{"UnsignedLongLongNDType", &Picoc::UnsignedLongLongNDType},
+		{"FunctionPtrNDType", &Picoc::FunctionPtrNDType},
+		{"DoubleNDType", &Picoc::DoubleNDType},
+		{"FloatNDType", &Picoc::FloatNDType},
+};
+
+const char *base_type_names[] = {
+		"TypeVoid", "TypeInt", "TypeShort", "TypeChar", "TypeLong", "TypeLongLong", "TypeUnsignedInt",
+		"TypeUnsignedShort", "TypeUnsignedChar", "TypeUnsignedLong", "TypeUnsignedLongLong", "TypeDouble", "TypeFloat",
+		"TypeFunction", "TypeFunctionPtr", "TypeMacro", "TypePointer", "TypeArray", "TypeStruct", "TypeUnion",
+		"TypeEnum", "TypeGotoLabel", "Type_Type",
+};
+
+std::string quoted(const char *str) {
+	std::string result = "\"";
+	for (const char *c = str; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\') {
+			result += '\\';
+		}
+		result += *c;
+	}
+	return result + "\"";
+}
+
+class ImageWriter {
+public:
+	explicit ImageWriter(Picoc *pc) : pc(pc) {}
+
+	// the index of the type in LibraryImageTypes, adding it if it's new
+	int type(ValueType *typ) {
+		std::vector<std::string> path;
+		while (typ->FromType != nullptr && typ->FromType != &pc->UberType) {
+			path.push_back(step("nullptr", typ));
+			typ = typ->FromType;
+		}
+
+		if (typ->FromType == nullptr) {
+			const char *member = nullptr;
+			for (auto const& m : base_type_members) {
+				if (&(pc->*m.member) == typ) {
+					member = m.name;
+				}
+			}
+			if (member == nullptr) {
+				std::cerr << "Unknown base type in a library prototype." << std::endl;
+				std::exit(1);
+			}
+			path.push_back(step((std::string("&Picoc::") + member).c_str(), typ));
+		} else {
+			path.push_back(step("nullptr", typ));
+		}
+
+		std::string key;
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			key += *it;
+		}
+		auto found = types.find(key);
+		if (found != types.end()) {
+			return found->second;
+		}
+
+		int index = static_cast<int>(types.size());
+		types.emplace(key, index);
+		type_defs << "\t{" << steps.size() << ", " << path.size() << "},\n";
+		steps.insert(steps.end(), path.rbegin(), path.rend());
+		return index;
+	}
+
+	void library(const char *library_name, LibraryFunction *func_list) {
+		std::ostringstream functions;
+		int count = 0;
+		for (; func_list[count].Prototype != nullptr; count++) {
+			functions << "\t" << function(func_list[count].Prototype) << ",\n";
+		}
+
+		std::string array = "Library" + std::to_string(libraries.size());
+		library_defs << "static const LibraryImageFunction " << array << "[] = {\n" << functions.str() << "};\n\n";
+		libraries.push_back("\t{" + quoted(library_name) + ", " + array + ", " + std::to_string(count) + "},\n");
+	}
+
+	void write(std::ostream& out) const {
+		out << "// Generated by tools/library_image.cpp, do not edit.\n\n";
+		out << "#include \"picoc/LibraryImage.hpp\"\n\n";
+		out << "const LibraryImageStep LibraryImageSteps[] = {\n";
+		for (auto const& s : steps) {
+			out << "\t" << s << ",\n";
+		}
+		out << "};\n\n";
+		out << "const LibraryImageType LibraryImageTypes[] = {\n" << type_defs.str() << "};\n\n";
+		out << "const int LibraryImageNumTypes = " << types.size() << ";\n\n";
+		out << "const int LibraryImageParamTypes[] = {\n" << param_types.str() << "\t-1\n};\n\n";
+		out << "const char *const LibraryImageParamNames[] = {\n" << param_names.str() << "\tnullptr\n};\n\n";
+		out << library_defs.str();
+		out << "const LibraryImage LibraryImages[] = {\n";
+		for (auto const& l : libraries) {
+			out << l;
+		}
+		out << "\t{nullptr, nullptr, 0}\n};\n";
+	}
+
+private:
+	std::string step(const char *root, ValueType *typ) {
+		return std::string("{") + root + ", BaseType::" + base_type_names[static_cast<int>(typ->Base)] + ", " +
+			   std::to_string(typ->ArraySize) + ", " + quoted(typ->Identifier) + "}";
+	}
+
+	// parses a prototype like LibraryAdd() does, without defining the function
+	std::string function(const char *prototype) {
+		ParseState parser;
+		char *identifier;
+		ValueType *return_type;
+		char *intrinsic_name = nitwit::table::TableStrRegister(pc, "c library");
+
+		void *tokens = nitwit::lex::LexAnalyse(pc, intrinsic_name, prototype, static_cast<int>(strlen(prototype)), nullptr);
+		nitwit::lex::LexInitParser(&parser, pc, prototype, tokens, intrinsic_name, TRUE, FALSE, nullptr);
+		TypeParse(&parser, &return_type, &identifier, nullptr, nullptr, false);
+		Value *func = nitwit::parse::ParseFunctionDefinition(&parser, return_type, identifier, true);
+		if (nitwit::lex::LexGetToken(&parser, nullptr, false) == TokenSemicolon) {
+			nitwit::lex::LexGetToken(&parser, nullptr, true);
+		}
+
+		FuncDef const& def = func->Val->FuncDef;
+		int first_param = param_count;
+		for (int i = 0; i < def.NumParams; i++) {
+			param_types << "\t" << type(def.ParamType[i]) << ",\n";
+			param_names << "\t" << quoted(def.ParamName[i]) << ",\n";
+		}
+		param_count += def.NumParams;
+
+		std::string result = "{" + quoted(prototype) + ", " + quoted(identifier) + ", " + std::to_string(type(def.ReturnType)) +
+							 ", " + std::to_string(def.NumParams) + ", " + std::to_string(def.VarArgs) + ", " +
+							 std::to_string(first_param) + ", " + std::to_string(parser.Line) + ", " +
+							 std::to_string(parser.CharacterPos) + "}";
+		HeapFreeMem(pc, tokens);
+		return result;
+	}
+
+	Picoc *pc;
+	std::map<std::string, int> types;
+	std::vector<std::string> steps;
+	std::ostringstream type_defs;
+	std::ostringstream param_types;
+	std::ostringstream param_names;
+	int param_count = 0;
+	std::ostringstream library_defs;
+	std::vector<std::string> libraries;
+};
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		std::cerr << "Usage: <nitwit_library_image> LibraryImage.cpp" << std::endl;
+		return 3;
+	}
+
+	Picoc pc;
+	PicocInitialise(&pc, 104857600);
+	if (PicocPlatformSetExitPoint(&pc)) {
+		std::cerr << "Parsing the library prototypes failed." << std::endl;
+		return 1;
+	}
+	PicocIncludeAllSystemHeaders(&pc);
+
+	ImageWriter writer(&pc);
+	for (IncludeLibrary *lib = pc.IncludeLibList; lib != nullptr; lib = lib->NextLib) {
+		if (lib->FuncList != nullptr) {
+			writer.library(lib->IncludeName, lib->FuncList);
+		}
+	}
+
+	std::ostringstream image;
+	writer.write(image);
+
+	std::ofstream out(argv[1]);
+	out << image.str();
+	if (!out) {
+		std::cerr << "Writing " << argv[1] << " failed." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -4,46 +4,154 @@
 
 #include "files.hpp"
 #include <algorithm>
+#include <cctype>
 #include <cerrno>
 #include <cstring>
+#include <string_view>
+#include <utility>
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <iostream>
-#include <fstream>
-#include <regex>
-#include <sstream>
 
-std::string readFile(const char *FileName, bool& error) {
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+        text(std::exchange(other.text, nullptr)), length(std::exchange(other.length, 0)),
+        mapped_length(std::exchange(other.mapped_length, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    std::swap(text, other.text);
+    std::swap(length, other.length);
+    std::swap(mapped_length, other.mapped_length);
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    if (text != nullptr) {
+        munmap(text, mapped_length);
+    }
+}
+
+/* the reach_error() definition found in some SV-COMP tasks. ' ' stands for optional whitespace, '~' for required
+ * whitespace, '#' for a run of digits and '$' for a string literal, everything else has to match literally */
+static char const *const wackyReachError = "void~reach_error() { ( ( void ) sizeof ( ( 0 ) ? 1 : 0) , __extension__ ( "
+                                           "{ if ( 0 ) ; else~__assert_fail ( \"#\" , $ , # , "
+                                           "__extension__~__PRETTY_FUNCTION__ ); }) ); }";
+
+/* returns the length of the pattern match starting at text, or 0. no part of the pattern can match in more than one
+ * way, so a single pass without backtracking suffices */
+static std::size_t matchPattern(char const *text, char const *end, char const *pattern) {
+    char const *p = text;
+    for (; *pattern != '\0'; ++pattern) {
+        switch (*pattern) {
+            case '~':
+                if (p == end || !isspace(static_cast<unsigned char>(*p))) return 0;
+                // fallthrough
+            case ' ':
+                while (p != end && isspace(static_cast<unsigned char>(*p))) ++p;
+                break;
+            case '#':
+                if (p == end || !isdigit(static_cast<unsigned char>(*p))) return 0;
+                while (p != end && isdigit(static_cast<unsigned char>(*p))) ++p;
+                break;
+            case '$':
+                if (p == end || *p != '"') return 0;
+                p = std::find(p + 1, end, '"');
+                if (p == end) return 0;
+                ++p;
+                break;
+            default:
+                if (p == end || *p != *pattern) return 0;
+                ++p;
+        }
+    }
+    return p - text;
+}
+
+/* replaces every wacky reach_error() definition by one calling abort(), padded so that all offsets stay the same.
+ * returns the number of replaced definitions */
+static std::size_t replaceWackyReachError(char *text, std::size_t length) {
+    std::string_view const source(text, length);
+    std::string_view const name = "reach_error()";
+    std::size_t replaced = 0;
+    std::size_t done = 0;
+
+    for (std::size_t found = source.find(name); found != std::string_view::npos; found = source.find(name, found + 1)) {
+        /* the match has to start at the "void" in front of the name */
+        std::size_t start = found;
+        while (start > done && isspace(static_cast<unsigned char>(text[start - 1]))) --start;
+        if (start == found || start < done + 4 || source.compare(start - 4, 4, "void") != 0) continue;
+        start -= 4;
+
+        std::size_t const matchLength = matchPattern(text + start, text + length, wackyReachError);
+        if (matchLength == 0) continue;
+
+        auto const numNewlines = std::count(text + start, text + start + matchLength, '\n');
+        std::string replacementFunction = "void reach_error() { abort(); " + std::string(numNewlines, '\n');
+        replacementFunction += std::string(matchLength - replacementFunction.size() - 1, ' ') + "}";
+        memcpy(text + start, replacementFunction.data(), matchLength);
+
+        done = start + matchLength;
+        found = done - 1;
+        replaced++;
+    }
+
+    return replaced;
+}
+
+MappedFile readFile(const char *FileName, bool& error) {
     error = false;
+    MappedFile file;
     struct stat FileInfo;
-    
+
     int const statResult = stat(FileName, &FileInfo);
     if (statResult != 0) {
         std::cerr << "Cannot read file '" << FileName << "', stat failed with error '" << strerror(errno) << "'." << std::endl;
         error = true;
-        return "";
+        return file;
+    }
+
+    int const fd = open(FileName, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot read file '" << FileName << "', open failed with error '" << strerror(errno) << "'." << std::endl;
+        error = true;
+        return file;
+    }
+
+    /* reserve zeroed memory at least one byte longer than the file and map the file over its start, so the text is
+     * always '\0' terminated, even when the file ends on a page boundary */
+    std::size_t const length = static_cast<std::size_t>(FileInfo.st_size);
+    std::size_t const pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t const mappedLength = (length / pageSize + 1) * pageSize;
+
+    void *base = mmap(nullptr, mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED && length > 0 &&
+        mmap(base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, mappedLength);
+        base = MAP_FAILED;
+    }
+    int const mapErrno = errno;
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot read file '" << FileName << "', mmap failed with error '" << strerror(mapErrno) << "'." << std::endl;
+        error = true;
+        return file;
     }
 
-    std::ifstream inStream(FileName);
-    std::stringstream buffer;
-    buffer << inStream.rdbuf();
+    file.text = static_cast<char *>(base);
+    file.length = length;
+    file.mapped_length = mappedLength;
 
     // Filter wacky stuff from the input...
-    std::string result = buffer.str();
-    std::regex re(R"((void\s+reach_error\(\)\s*\{\s*\(\s*\(\s*void\s*\)\s*sizeof\s*\(\s*\(\s*0\s*\)\s*\?\s*1\s*:\s*0\)\s*,\s*__extension__\s*\(\s*\{\s*if\s*\(\s*0\s*\)\s*;\s*else\s+__assert_fail\s*\(\s*"\d+"\s*,\s*"[^"]*"\s*,\s*\d+\s*,\s*__extension__\s+__PRETTY_FUNCTION__\s*\);\s*\}\)\s*\);\s*\}))");
-    std::smatch match;
-    if (std::regex_search(result, match, re) && match.size() > 1) {
-        // Count the number of newlines in the match
-        std::string const matchText = match.str(1);
-        auto const numNewlines = std::count(matchText.begin(), matchText.end(), '\n');
-        std::string replacementFunction = R"(void reach_error() { abort(); )" + std::string(numNewlines, '\n') + R"(})";
-        result = std::regex_replace(result, re, replacementFunction);
-        std::cerr << "Warning: Replaced wacky reach_error function definition containing ugly __extension__, offsets might be a little off!" << std::endl;
+    if (replaceWackyReachError(file.text, file.length) > 0) {
+        std::cerr << "Warning: Replaced wacky reach_error function definition containing ugly __extension__." << std::endl;
     }
     else {
         std::cout << "No changes done." << std::endl;
     }
 
-    return result;
+    return file;
 }
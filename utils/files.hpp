@@ -7,9 +7,31 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstddef>
 
 #include <string>
 
-std::string readFile(const char *FileName, bool& error);
+/* a source file mapped into memory. the text is writable (changes stay private) and followed by a '\0' */
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    ~MappedFile();
+
+    char *data() const { return text; }
+    std::size_t size() const { return length; }
+
+private:
+    char *text = nullptr;
+    std::size_t length = 0;
+    std::size_t mapped_length = 0;
+
+    friend MappedFile readFile(const char *FileName, bool& error);
+};
+
+MappedFile readFile(const char *FileName, bool& error);
 
 #endif //NITWIT_FILES_HPP
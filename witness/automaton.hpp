@@ -12,13 +12,12 @@
 #undef min
 
 #include <cstddef>
-#include "../utils/pugixml/pugixml.hpp"
+#include <cstdint>
 #include <string>
 #include <deque>
 #include <utility>
 #include <vector>
 #include <map>
-#include <set>
 #include <functional>
 #include <memory>
 #include <algorithm>
@@ -51,14 +50,42 @@ public:
 	bool is_loopHead{};
 	std::size_t thread_number{};
 
+	/* marks an edge end that does not name a node of the witness */
+	static constexpr std::size_t invalid_index = static_cast<std::size_t>(-1);
+
 	void print() const;
 };
 
 
+/* a single ';'-separated assumption of an edge, lexed once and re-run from its tokens on every check */
+struct CompiledAssumption {
+	std::string text;
+	Picoc *pc = nullptr;                /* the interpreter the tokens and identifiers belong to */
+	void *tokens = nullptr;             /* on the interpreter's heap */
+	char *reg_file_name = nullptr;
+	bool is_lexed = false;
+	bool lex_failed = false;
+
+	/* fast path for "\result == <const>" */
+	bool is_result_assumption = false;
+	bool has_result_value = false;
+	ValueType *result_type = nullptr;
+	AnyValue result_value{};
+
+	explicit CompiledAssumption(std::string text) : text(std::move(text)) {}
+	CompiledAssumption(CompiledAssumption&& other) noexcept;
+	CompiledAssumption(CompiledAssumption const&) = delete;
+	CompiledAssumption& operator=(CompiledAssumption const&) = delete;
+
+	void reset();
+};
+
 class Edge {
 public:
 	std::string source_id;
 	std::string target_id;
+	std::size_t source = Node::invalid_index;   /* dense node indices, resolved while parsing */
+	std::size_t target = Node::invalid_index;
 	std::string origin_file;
 	std::string assumption;
 	std::string assumption_scope;
@@ -67,12 +94,15 @@ public:
 	std::string return_from_function;
 	std::string source_code;
 	std::string control;
-	ConditionControl controlCondition;
-	std::size_t start_line;
-	std::size_t end_line;
-	std::size_t start_offset;
-	std::size_t end_offset;
-	bool enterLoopHead;
+	ConditionControl controlCondition{};
+	std::size_t start_line{};
+	std::size_t end_line{};
+	std::size_t start_offset{};
+	std::size_t end_offset{};
+	bool enterLoopHead{};
+	std::vector<CompiledAssumption> compiled_assumptions;
+
+	void prepareAssumptions();
 
 	void print() const;
 };
@@ -105,7 +135,7 @@ class DefaultKeyValues {
 public:
 	void addKey(Key const& k);
 
-	Key getDefault(std::string const& id) const;
+	Key const& getDefault(std::string const& id) const;
 
 	void print() const;
 };
@@ -122,21 +152,61 @@ struct Data {
 	void print() const;
 };
 
+/* where the automaton of a witness is cached, see automaton_cache.cpp */
+struct WitnessCacheEntry {
+	std::string path;                   /* empty if the witness isn't cached */
+	std::uint64_t witness_size = 0;
+	std::uint64_t witness_hash = 0;
+};
+
+/* per-node lookup of the outgoing edges whose line range can match the statement being executed */
+class EdgeLineIndex {
+public:
+	struct Entry {
+		std::size_t start_line;
+		std::size_t end_line;
+		std::size_t max_end_line;       /* largest end_line in the implicit subtree rooted at this entry */
+		std::size_t rank;               /* position among the node's outgoing edges, candidates are tried in this order */
+		Edge *edge;
+	};
+
+	void build(Edge *first, Edge *last);
+
+	void candidates(std::size_t line, bool isMultiLineDeclaration, std::size_t endLine, std::vector<Entry const*>& out) const;
+
+private:
+	std::vector<Entry> by_start_line;   /* sorted by start_line, forms an implicit interval tree */
+	std::vector<Entry> wildcards;       /* line 0 edges, these match every statement */
+	std::vector<Entry> irregular;       /* end_line < start_line, only checked linearly */
+
+	std::size_t buildSubtree(std::size_t lo, std::size_t hi);
+
+	void stab(std::size_t lo, std::size_t hi, std::size_t line, std::vector<Entry const*>& out) const;
+};
+
 class WitnessAutomaton {
 private:
-	std::map<std::string, std::shared_ptr<Node>> nodes;
-	std::vector<std::shared_ptr<Edge>> edges;
+	std::vector<Node> nodes;                    /* indexed by the node ids interned while parsing */
+	std::vector<Edge> edges;                    /* grouped by source node, in file order within a group */
 	Data data;
-	std::shared_ptr<Node> current_state;
-
-	std::map<std::string, std::set<std::shared_ptr<Edge>>> successor_rel;
-	std::map<std::string, std::set<std::shared_ptr<Edge>>> predecessor_rel;
+	std::size_t current_state = Node::invalid_index;
+	std::size_t sink_state = Node::invalid_index;
+
+	/* compressed sparse rows: the edges leaving node n are edges[successor_offsets[n] .. successor_offsets[n + 1]),
+	 * the edges entering it are edges[predecessor_edges[i]] for i in [predecessor_offsets[n], predecessor_offsets[n + 1]) */
+	std::vector<std::size_t> successor_offsets;
+	std::vector<std::size_t> predecessor_offsets;
+	std::vector<std::size_t> predecessor_edges;
+	std::vector<EdgeLineIndex> successor_index;
+	std::vector<EdgeLineIndex::Entry const*> candidate_buffer;
 	bool illegal_state = false;
 	bool verifier_error_called = false;
 	std::size_t unsuccessfulTries = 0;
 
+	void buildSuccessorIndex();
+
 public:
-	WitnessAutomaton(std::map<std::string, std::shared_ptr<Node>> const& nodes, std::vector<std::shared_ptr<Edge>> const& edges, std::shared_ptr<Data>& data);
+	WitnessAutomaton(std::vector<Node>&& nodes, std::vector<Edge>&& edges, std::shared_ptr<Data>& data);
 
 	WitnessAutomaton();
 
@@ -150,7 +220,15 @@ public:
 
 	bool isInIllegalState() const;
 
-	static std::shared_ptr<WitnessAutomaton> automatonFromWitness(std::shared_ptr<pugi::xml_document> const& doc);
+	/* reads the GraphML witness, or its cached automaton if there is one. nullptr if it can't be read */
+	static std::shared_ptr<WitnessAutomaton> automatonFromWitness(std::string const& filename);
+
+	static WitnessCacheEntry cacheEntryFor(std::string const& filename);
+
+	/* nullptr if the entry's file is missing, damaged or made for another witness */
+	static std::shared_ptr<WitnessAutomaton> automatonFromCache(WitnessCacheEntry const& entry);
+
+	void writeCache(WitnessCacheEntry const& entry) const;
 
 	bool isInViolationState() const;
 
@@ -158,7 +236,7 @@ public:
 
 	bool wasVerifierErrorCalled() const;
 
-	const std::shared_ptr<Node>& getCurrentState() const;
+	Node const& getCurrentState() const;
 
 	bool canTransitionFurther();
 
@@ -0,0 +1,440 @@
+//
+// A binary cache of reconstructed witness automata, so that validating the same witness again skips the GraphML.
+//
+// A cache file is named after the hash of the witness it was made from and laid out as:
+//   CacheHeader
+//   CacheNode[num_nodes]
+//   CacheEdge[num_edges]                   grouped by source node, as WitnessAutomaton keeps them
+//   uint64_t successor_offsets[num_nodes + 1]
+//   uint64_t predecessor_offsets[num_nodes + 1]
+//   uint64_t predecessor_edges[num_edges]
+//   CacheString assumptions[num_assumptions]   the assumptions of the edges, already split at ';'
+//   char pool[pool_size]                   every distinct string once
+//
+
+#include "automaton.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char cache_magic[8] = {'N', 'I', 'T', 'W', 'I', 'T', 'A', '\0'};
+constexpr std::uint32_t cache_version = 1;              /* bump with every change to the layout or to the parsing */
+constexpr std::uint32_t cache_byte_order = 0x01020304;  /* reads differently on a machine of the other byte order */
+constexpr std::uint64_t cache_invalid_index = ~static_cast<std::uint64_t>(0);
+
+struct CacheString {
+	std::uint32_t offset;               /* into the pool */
+	std::uint32_t length;
+};
+
+struct CacheHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint64_t witness_size;
+	std::uint64_t witness_hash;
+	std::uint64_t num_nodes;
+	std::uint64_t num_edges;
+	std::uint64_t num_assumptions;
+	std::uint64_t pool_size;
+	std::uint64_t current_state;
+	std::uint64_t sink_state;
+	CacheString data[7];                /* the fields of Data in their order */
+	std::uint32_t padding[2];
+};
+
+enum CacheNodeFlags : std::uint32_t {
+	NodeEntry = 1, NodeViolation = 2, NodeSink = 4, NodeFrontier = 8, NodeLoopHead = 16
+};
+
+struct CacheNode {
+	CacheString id;
+	CacheString node_type;
+	CacheString invariant;
+	CacheString invariant_scope;
+	std::uint64_t thread_number;
+	std::uint32_t flags;
+	std::uint32_t padding;
+};
+
+struct CacheEdge {
+	CacheString source_id;
+	CacheString target_id;
+	CacheString origin_file;
+	CacheString assumption;
+	CacheString assumption_scope;
+	CacheString assumption_result_function;
+	CacheString enter_function;
+	CacheString return_from_function;
+	CacheString source_code;
+	CacheString control;
+	std::uint64_t source;
+	std::uint64_t target;
+	std::uint64_t start_line;
+	std::uint64_t end_line;
+	std::uint64_t start_offset;
+	std::uint64_t end_offset;
+	std::uint64_t first_assumption;     /* in the assumptions */
+	std::uint32_t num_assumptions;
+	std::int32_t control_condition;
+	std::uint32_t enter_loop_head;
+	std::uint32_t padding;
+};
+
+// the same layout for nitwit32 and nitwit64, which may share the cache
+static_assert(sizeof(CacheHeader) == 144 && sizeof(CacheNode) == 48 && sizeof(CacheEdge) == 152,
+			  "the cache layout must not depend on the architecture");
+
+/* collects the strings of the automaton, each distinct one once */
+class StringPool {
+public:
+	CacheString add(std::string const& s) {
+		auto found = offsets.find(s);
+		if (found != offsets.end()) {
+			return {found->second, static_cast<std::uint32_t>(s.size())};
+		}
+		if (pool.size() + s.size() > UINT32_MAX) {
+			overflow = true;
+			return {0, 0};
+		}
+		auto offset = static_cast<std::uint32_t>(pool.size());
+		pool += s;
+		offsets.emplace(s, offset);
+		return {offset, static_cast<std::uint32_t>(s.size())};
+	}
+
+	std::string pool;
+	bool overflow = false;
+
+private:
+	std::unordered_map<std::string, std::uint32_t> offsets;
+};
+
+std::uint64_t toCacheIndex(std::size_t index) {
+	return index == Node::invalid_index ? cache_invalid_index : index;
+}
+
+std::size_t fromCacheIndex(std::uint64_t index) {
+	return index == cache_invalid_index ? Node::invalid_index : static_cast<std::size_t>(index);
+}
+
+template<typename T>
+void append(std::string& out, T const& value) {
+	out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+/* the directory the cache files go to, empty if caching is off */
+std::string cacheDirectory() {
+	char const* dir = getenv("NITWIT_WITNESS_CACHE_DIR");
+	if (dir != nullptr) {
+		return dir;
+	}
+	dir = getenv("XDG_CACHE_HOME");
+	if (dir != nullptr && *dir != '\0') {
+		return std::string(dir) + "/nitwit";
+	}
+	dir = getenv("HOME");
+	if (dir != nullptr && *dir != '\0') {
+		return std::string(dir) + "/.cache/nitwit";
+	}
+	return std::string();
+}
+
+/* a read-only mapping of a whole file */
+class MappedReadOnlyFile {
+public:
+	explicit MappedReadOnlyFile(std::string const& path) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat st{};
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED) {
+				data = static_cast<char const*>(mapped);
+				size = st.st_size;
+			}
+		}
+		close(fd);
+	}
+
+	MappedReadOnlyFile(MappedReadOnlyFile const&) = delete;
+	MappedReadOnlyFile& operator=(MappedReadOnlyFile const&) = delete;
+
+	~MappedReadOnlyFile() {
+		if (data != nullptr) {
+			munmap(const_cast<char *>(data), size);
+		}
+	}
+
+	char const* data = nullptr;
+	std::size_t size = 0;
+};
+
+}
+
+WitnessCacheEntry WitnessAutomaton::cacheEntryFor(std::string const& filename) {
+	WitnessCacheEntry entry;
+#ifndef NO_WITNESS_CACHE
+	std::string dir = cacheDirectory();
+	if (dir.empty()) {
+		return entry;
+	}
+
+	MappedReadOnlyFile witness(filename);
+	if (witness.data == nullptr || witness.size > UINT_MAX) {
+		return entry;
+	}
+	entry.witness_size = witness.size;
+	entry.witness_hash = nitwit::table::TableHash(witness.data, static_cast<unsigned>(witness.size));
+
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx-%llu.nwa", static_cast<unsigned long long>(entry.witness_hash),
+			 static_cast<unsigned long long>(entry.witness_size));
+	entry.path = dir + name;
+#endif
+	return entry;
+}
+
+std::shared_ptr<WitnessAutomaton> WitnessAutomaton::automatonFromCache(WitnessCacheEntry const& entry) {
+	if (entry.path.empty()) {
+		return nullptr;
+	}
+	MappedReadOnlyFile file(entry.path);
+	if (file.data == nullptr || file.size < sizeof(CacheHeader)) {
+		return nullptr;
+	}
+
+	auto const* header = reinterpret_cast<CacheHeader const*>(file.data);
+	if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 || header->version != cache_version ||
+		header->byte_order != cache_byte_order || header->witness_size != entry.witness_size ||
+		header->witness_hash != entry.witness_hash) {
+		return nullptr;
+	}
+
+	std::uint64_t num_nodes = header->num_nodes;
+	std::uint64_t num_edges = header->num_edges;
+	std::uint64_t expected_size = sizeof(CacheHeader) + num_nodes * sizeof(CacheNode) + num_edges * sizeof(CacheEdge) +
+								  (2 * (num_nodes + 1) + num_edges) * sizeof(std::uint64_t) +
+								  header->num_assumptions * sizeof(CacheString) + header->pool_size;
+	if (num_nodes > file.size || num_edges > file.size || header->num_assumptions > file.size || header->pool_size > file.size ||
+		expected_size != file.size) {
+		return nullptr;
+	}
+
+	auto const* nodes = reinterpret_cast<CacheNode const*>(header + 1);
+	auto const* edges = reinterpret_cast<CacheEdge const*>(nodes + num_nodes);
+	auto const* successor_offsets = reinterpret_cast<std::uint64_t const*>(edges + num_edges);
+	auto const* predecessor_offsets = successor_offsets + num_nodes + 1;
+	auto const* predecessor_edges = predecessor_offsets + num_nodes + 1;
+	auto const* assumptions = reinterpret_cast<CacheString const*>(predecessor_edges + num_edges);
+	char const* pool = reinterpret_cast<char const*>(assumptions + header->num_assumptions);
+	bool damaged = false;
+	auto str = [&](CacheString s) {
+		if (static_cast<std::uint64_t>(s.offset) + s.length > header->pool_size) {
+			damaged = true;
+			return std::string();
+		}
+		return std::string(pool + s.offset, s.length);
+	};
+
+	auto aut = std::make_shared<WitnessAutomaton>();
+	aut->data.source_code_lang = str(header->data[0]);
+	aut->data.program_file = str(header->data[1]);
+	aut->data.program_hash = str(header->data[2]);
+	aut->data.specification = str(header->data[3]);
+	aut->data.architecture = str(header->data[4]);
+	aut->data.producer = str(header->data[5]);
+	aut->data.witness_type = str(header->data[6]);
+	aut->current_state = fromCacheIndex(header->current_state);
+	aut->sink_state = fromCacheIndex(header->sink_state);
+
+	aut->nodes.clear();
+	aut->nodes.resize(num_nodes);
+	for (std::size_t n = 0; n < num_nodes; ++n) {
+		Node& node = aut->nodes[n];
+		node.id = str(nodes[n].id);
+		node.node_type = str(nodes[n].node_type);
+		node.invariant = str(nodes[n].invariant);
+		node.invariant_scope = str(nodes[n].invariant_scope);
+		node.thread_number = nodes[n].thread_number;
+		node.is_entry = (nodes[n].flags & NodeEntry) != 0;
+		node.is_violation = (nodes[n].flags & NodeViolation) != 0;
+		node.is_sink = (nodes[n].flags & NodeSink) != 0;
+		node.is_frontier = (nodes[n].flags & NodeFrontier) != 0;
+		node.is_loopHead = (nodes[n].flags & NodeLoopHead) != 0;
+	}
+
+	aut->edges.clear();
+	aut->edges.resize(num_edges);
+	for (std::size_t e = 0; e < num_edges; ++e) {
+		CacheEdge const& cached = edges[e];
+		Edge& edge = aut->edges[e];
+		edge.source_id = str(cached.source_id);
+		edge.target_id = str(cached.target_id);
+		edge.origin_file = str(cached.origin_file);
+		edge.assumption = str(cached.assumption);
+		edge.assumption_scope = str(cached.assumption_scope);
+		edge.assumption_result_function = str(cached.assumption_result_function);
+		edge.enter_function = str(cached.enter_function);
+		edge.return_from_function = str(cached.return_from_function);
+		edge.source_code = str(cached.source_code);
+		edge.control = str(cached.control);
+		edge.source = fromCacheIndex(cached.source);
+		edge.target = fromCacheIndex(cached.target);
+		edge.start_line = cached.start_line;
+		edge.end_line = cached.end_line;
+		edge.start_offset = cached.start_offset;
+		edge.end_offset = cached.end_offset;
+		edge.controlCondition = static_cast<ConditionControl>(cached.control_condition);
+		edge.enterLoopHead = cached.enter_loop_head != 0;
+		if (cached.first_assumption + cached.num_assumptions > header->num_assumptions ||
+			edge.source >= num_nodes || edge.target >= num_nodes) {
+			return nullptr;
+		}
+		edge.compiled_assumptions.reserve(cached.num_assumptions);
+		for (std::uint32_t a = 0; a < cached.num_assumptions; ++a) {
+			edge.compiled_assumptions.emplace_back(str(assumptions[cached.first_assumption + a]));
+		}
+	}
+
+	aut->successor_offsets.assign(successor_offsets, successor_offsets + num_nodes + 1);
+	aut->predecessor_offsets.assign(predecessor_offsets, predecessor_offsets + num_nodes + 1);
+	aut->predecessor_edges.assign(predecessor_edges, predecessor_edges + num_edges);
+	if (damaged || aut->successor_offsets.back() != num_edges || aut->predecessor_offsets.back() != num_edges ||
+		(aut->current_state != Node::invalid_index && aut->current_state >= num_nodes)) {
+		return nullptr;
+	}
+	for (std::size_t n = 0; n < num_nodes; ++n) {
+		if (aut->successor_offsets[n] > aut->successor_offsets[n + 1] ||
+			aut->predecessor_offsets[n] > aut->predecessor_offsets[n + 1]) {
+			return nullptr;
+		}
+	}
+	for (std::size_t p: aut->predecessor_edges) {
+		if (p >= num_edges) {
+			return nullptr;
+		}
+	}
+
+	aut->buildSuccessorIndex();
+	return aut;
+}
+
+void WitnessAutomaton::writeCache(WitnessCacheEntry const& entry) const {
+	if (entry.path.empty() || illegal_state) {
+		return;
+	}
+
+	StringPool strings;
+	std::string body;
+	std::vector<CacheString> assumptions;
+
+	CacheHeader header{};
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.byte_order = cache_byte_order;
+	header.witness_size = entry.witness_size;
+	header.witness_hash = entry.witness_hash;
+	header.num_nodes = nodes.size();
+	header.num_edges = edges.size();
+	header.current_state = toCacheIndex(current_state);
+	header.sink_state = toCacheIndex(sink_state);
+	header.data[0] = strings.add(data.source_code_lang);
+	header.data[1] = strings.add(data.program_file);
+	header.data[2] = strings.add(data.program_hash);
+	header.data[3] = strings.add(data.specification);
+	header.data[4] = strings.add(data.architecture);
+	header.data[5] = strings.add(data.producer);
+	header.data[6] = strings.add(data.witness_type);
+
+	for (Node const& node: nodes) {
+		CacheNode cached{};
+		cached.id = strings.add(node.id);
+		cached.node_type = strings.add(node.node_type);
+		cached.invariant = strings.add(node.invariant);
+		cached.invariant_scope = strings.add(node.invariant_scope);
+		cached.thread_number = node.thread_number;
+		cached.flags = (node.is_entry ? NodeEntry : 0) | (node.is_violation ? NodeViolation : 0) |
+					   (node.is_sink ? NodeSink : 0) | (node.is_frontier ? NodeFrontier : 0) |
+					   (node.is_loopHead ? NodeLoopHead : 0);
+		append(body, cached);
+	}
+
+	for (Edge const& edge: edges) {
+		CacheEdge cached{};
+		cached.source_id = strings.add(edge.source_id);
+		cached.target_id = strings.add(edge.target_id);
+		cached.origin_file = strings.add(edge.origin_file);
+		cached.assumption = strings.add(edge.assumption);
+		cached.assumption_scope = strings.add(edge.assumption_scope);
+		cached.assumption_result_function = strings.add(edge.assumption_result_function);
+		cached.enter_function = strings.add(edge.enter_function);
+		cached.return_from_function = strings.add(edge.return_from_function);
+		cached.source_code = strings.add(edge.source_code);
+		cached.control = strings.add(edge.control);
+		cached.source = toCacheIndex(edge.source);
+		cached.target = toCacheIndex(edge.target);
+		cached.start_line = edge.start_line;
+		cached.end_line = edge.end_line;
+		cached.start_offset = edge.start_offset;
+		cached.end_offset = edge.end_offset;
+		cached.first_assumption = assumptions.size();
+		cached.num_assumptions = static_cast<std::uint32_t>(edge.compiled_assumptions.size());
+		cached.control_condition = edge.controlCondition;
+		cached.enter_loop_head = edge.enterLoopHead;
+		for (CompiledAssumption const& ca: edge.compiled_assumptions) {
+			assumptions.push_back(strings.add(ca.text));
+		}
+		append(body, cached);
+	}
+
+	for (std::size_t offset: successor_offsets) {
+		append(body, static_cast<std::uint64_t>(offset));
+	}
+	for (std::size_t offset: predecessor_offsets) {
+		append(body, static_cast<std::uint64_t>(offset));
+	}
+	for (std::size_t e: predecessor_edges) {
+		append(body, static_cast<std::uint64_t>(e));
+	}
+	for (CacheString const& s: assumptions) {
+		append(body, s);
+	}
+	if (strings.overflow) {
+		return;
+	}
+	header.num_assumptions = assumptions.size();
+	header.pool_size = strings.pool.size();
+
+	// written under a name of its own and renamed, so that a validation running alongside never sees half a file
+	std::string dir = entry.path.substr(0, entry.path.find_last_of('/'));
+	std::string parent = dir.substr(0, dir.find_last_of('/'));
+	mkdir(parent.c_str(), 0755);
+	mkdir(dir.c_str(), 0755);
+	std::string temp_path = entry.path + "." + std::to_string(getpid());
+	FILE *out = fopen(temp_path.c_str(), "wb");
+	if (out == nullptr) {
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+				   fwrite(body.data(), 1, body.size(), out) == body.size() &&
+				   fwrite(strings.pool.data(), 1, strings.pool.size(), out) == strings.pool.size();
+	if (fclose(out) != 0 || !written || rename(temp_path.c_str(), entry.path.c_str()) != 0) {
+		unlink(temp_path.c_str());
+		return;
+	}
+	cw_verbose("Cached the witness automaton in %s\n", entry.path.c_str());
+}
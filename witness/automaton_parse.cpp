@@ -4,101 +4,310 @@
 //
 
 #include "automaton.hpp"
+#include "witness.hpp"
 
+#include <cctype>
 #include <cstdlib>
-#include <regex>
+#include <cstring>
+#include <exception>
 #include <string>
-
-std::shared_ptr<DefaultKeyValues> parseKeys(pugi::xpath_node_set const& keyNodeSet);
+#ifndef NO_PARALLEL_WITNESS
+#include <thread>
+#endif
 
 std::shared_ptr<DefaultKeyValues> getDefaultKeys();
 
-std::map<std::string, std::shared_ptr<Node>> parseNodes(pugi::xpath_node_set const& set, std::shared_ptr<DefaultKeyValues> const& defaultKeyValues);
+void setNodeAttributes(Node& node, char const *name, char const *value);
+
+Node getDefaultNode(std::shared_ptr<DefaultKeyValues> const& def_values);
+
+Edge getDefaultEdge(std::shared_ptr<DefaultKeyValues> const& def_values);
 
-void setNodeAttributes(std::shared_ptr<Node> const& node, char const *name, char const *value);
+Edge copyEdgeDefaults(Edge const& defaults);
 
-std::shared_ptr<Node> getDefaultNode(std::shared_ptr<DefaultKeyValues> const& def_values);
+void setEdgeAttributes(Edge& edge, char const *name, char const *value);
 
-std::vector<std::shared_ptr<Edge>> parseEdges(pugi::xpath_node_set const& set, std::map<std::string, std::shared_ptr<Node>> const& graphNodes, std::shared_ptr<DefaultKeyValues> const& defaultKeyValues);
+void fixEdgeProperties(Edge& edge);
 
-std::shared_ptr<Data> parseData(const pugi::xpath_node_set& set);
+void setKeyAttributes(Key *key, const char *name, const char *value);
 
-std::shared_ptr<WitnessAutomaton> WitnessAutomaton::automatonFromWitness(std::shared_ptr<pugi::xml_document> const& doc) {
-	pugi::xml_node root = doc->root().first_child();
-	if (!root || strcmp(root.name(), "graphml") != 0) {
-		std::cerr << " ### No graphml root element." << std::endl;
-		return std::make_shared<WitnessAutomaton>();
+void setDataAttributes(Data& data, char const *name, char const *value);
+
+std::size_t findNodeIndex(std::map<std::string, std::size_t> const& nodeIds, char const *id);
+
+/* the least elements a thread gets when building an automaton, below that a thread costs more than it saves */
+static std::size_t const min_parallel_range = 1 << 14;
+
+/* calls body on consecutive ranges that cover [0, count), at the same time if there are enough elements for more
+ * than one thread. body must only touch the elements of its own range */
+template<typename Body>
+static void forEachRange(std::size_t count, Body const& body) {
+	std::size_t threads = 1;
+#ifndef NO_PARALLEL_WITNESS
+	threads = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), count / min_parallel_range);
+#endif
+	if (threads <= 1) {
+		body(0, count);
+		return;
+	}
+#ifndef NO_PARALLEL_WITNESS
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> errors(threads);
+	workers.reserve(threads - 1);
+	for (std::size_t t = 1; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			try {
+				body(count * t / threads, count * (t + 1) / threads);
+			} catch (...) {
+				errors[t] = std::current_exception();
+			}
+		});
+	}
+	try {
+		body(0, count / threads);
+	} catch (...) {
+		errors[0] = std::current_exception();
+	}
+	for (auto& worker: workers) {
+		worker.join();
+	}
+	for (auto const& error: errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
 	}
-	std::string xpath = "/graphml/key"; // TODO add attributes
-	auto key_result = doc->select_nodes(pugi::xpath_query(xpath.c_str()));
+#endif
+}
 
-	std::shared_ptr<DefaultKeyValues> default_key_values;
-	if (key_result.empty()) {
-		std::cerr << " ### No graphml keys found!" << std::endl;
-		default_key_values = getDefaultKeys();
-	} else {
-		default_key_values = parseKeys(key_result);
+static char const *findAttribute(GraphmlHandler::Attributes const& attributes, char const *name) {
+	for (auto const& attr: attributes) {
+		if (strcmp(attr.first, name) == 0) {
+			return attr.second;
+		}
+	}
+	return nullptr;
+}
+
+/* builds the nodes and edges as their elements end, so that the witness is never held in memory as a whole. the keys
+ * have to come before the graph, as GraphML has it, to give the defaults of its nodes and edges */
+class WitnessBuilder : public GraphmlHandler {
+public:
+	void startElement(std::size_t depth, char const *name, Attributes const& attributes) override {
+		if (depth == 2) {
+			in_key = strcmp(name, "key") == 0;
+			in_graph = strcmp(name, "graph") == 0;
+			if (in_key) {
+				key = Key();
+				key_has_default = false;
+				for (auto const& attr: attributes) {
+					setKeyAttributes(&key, attr.first, attr.second);
+				}
+			}
+		} else if (depth == 3 && in_graph) {
+			in_node = strcmp(name, "node") == 0 && findAttribute(attributes, "id") != nullptr;
+			in_edge = strcmp(name, "edge") == 0 && findAttribute(attributes, "source") != nullptr &&
+					  findAttribute(attributes, "target") != nullptr;
+			if (in_node) {
+				node = nodeTemplate();
+				for (auto const& attr: attributes) {
+					setNodeAttributes(node, attr.first, attr.second);
+				}
+			} else if (in_edge) {
+				edges.push_back(copyEdgeDefaults(edgeTemplate()));
+				loop_head_given.push_back(false);
+				for (auto const& attr: attributes) {
+					setEdgeAttribute(attr.first, attr.second);
+				}
+			} else {
+				startData(name, attributes);
+			}
+		} else if (depth == 4 && (in_node || in_edge)) {
+			startData(name, attributes);
+		}
 	}
 
-	xpath = "/graphml/graph/node[@id]";
-	auto node_result = doc->select_nodes(pugi::xpath_query(xpath.c_str()));
-	if (node_result.empty()) {
-		std::cerr << " ### There should be at least 1 node!" << std::endl;
-		return std::make_shared<WitnessAutomaton>();
+	void endElement(std::size_t depth, char const *name, std::string const& text) override {
+		if (depth == 2) {
+			if (in_key) {
+				if (!default_key_values) {
+					default_key_values = std::make_shared<DefaultKeyValues>();
+				}
+				default_key_values->addKey(key);
+				templates_valid = false;
+			}
+			in_key = in_graph = false;
+		} else if (depth == 3 && in_key) {
+			if (strcmp(name, "default") == 0 && !key_has_default) {
+				key.default_val = text;
+				key_has_default = true;
+			}
+		} else if (depth == 3 && in_graph) {
+			if (in_node) {
+				// the first definition of an id wins, later duplicates are dropped
+				if (node_ids.emplace(node.id, nodes.size()).second) {
+					nodes.push_back(std::move(node));
+				}
+			} else if (in_edge) {
+				fixEdgeProperties(edges.back());
+			} else if (in_data) {
+				setDataAttributes(*data, data_key.c_str(), text.c_str());
+				++graph_data_count;
+			}
+			in_node = in_edge = in_data = false;
+		} else if (depth == 4 && in_data) {
+			if (in_node) {
+				setNodeAttributes(node, data_key.c_str(), text.c_str());
+			} else {
+				setEdgeAttribute(data_key.c_str(), text.c_str());
+			}
+			in_data = false;
+		}
+	}
+
+	/* checks that the witness had all parts of an automaton and resolves the ends of the edges */
+	std::shared_ptr<WitnessAutomaton> finish() {
+		defaults();
+		if (keys_missing) {
+			std::cerr << " ### No graphml keys found!" << std::endl;
+		}
+		if (nodes.empty()) {
+			std::cerr << " ### There should be at least 1 node!" << std::endl;
+			return std::make_shared<WitnessAutomaton>();
+		}
+		if (edges.empty()) {
+			std::cerr << " ### There are no edges!" << std::endl;
+			return std::make_shared<WitnessAutomaton>(); // TODO Could there be witnesses with no edges?
+		}
+		if (graph_data_count == 0) {
+			std::cerr << " ### There are no graph data!" << std::endl;
+			throw;
+		}
+
+		// node ids are only needed to resolve the edge ends, the automaton works on their indices. an edge may come
+		// before its nodes, so this waits for the end of the witness
+		forEachRange(edges.size(), [this](std::size_t first, std::size_t last) {
+			for (std::size_t e = first; e < last; ++e) {
+				Edge& edge = edges[e];
+				edge.source = findNodeIndex(node_ids, edge.source_id.c_str());
+				edge.target = findNodeIndex(node_ids, edge.target_id.c_str());
+				// entering a loopHead node enters the loop, unless the edge says otherwise
+				if (!loop_head_given[e] && edge.target != Node::invalid_index && nodes[edge.target].is_loopHead) {
+					edge.enterLoopHead = true;
+				}
+			}
+		});
+		complete = true;
+		return std::make_shared<WitnessAutomaton>(std::move(nodes), std::move(edges), data);
 	}
 
-	xpath = "/graphml/graph/edge[@source and @target]";
-	auto edge_result = doc->select_nodes(pugi::xpath_query(xpath.c_str()));
-	if (edge_result.empty()) {
-		std::cerr << " ### There are no edges!" << std::endl;
-		return std::make_shared<WitnessAutomaton>(); // TODO Could there be witnesses with no edges?
+	/* whether finish() made the automaton of the witness rather than a stand-in */
+	bool isComplete() const {
+		return complete;
 	}
 
-	xpath = "/graphml/graph/data[@key]";
-	auto graph_data_result = doc->select_nodes(pugi::xpath_query(xpath.c_str()));
-	if (graph_data_result.empty()) {
-		std::cerr << " ### There are no graph data!" << std::endl;
-//        return make_shared<WitnessAutomaton>();
-		throw;
+private:
+	std::shared_ptr<DefaultKeyValues> default_key_values;
+	std::map<std::string, std::size_t> node_ids;
+	std::vector<Node> nodes;
+	std::vector<Edge> edges;
+	std::vector<bool> loop_head_given;          /* per edge, whether it had an enterLoopHead of its own */
+	std::shared_ptr<Data> data = std::make_shared<Data>();
+	std::size_t graph_data_count = 0;
+	bool keys_missing = false;                  /* the defaults are the built-in ones */
+	bool complete = false;
+
+	/* a node and an edge with every default of the keys, copied for each one that starts */
+	Node node_template;
+	Edge edge_template;
+	bool templates_valid = false;
+
+	Key key;
+	bool key_has_default = false;
+	Node node;
+	std::string data_key;
+	bool in_key = false;
+	bool in_graph = false;
+	bool in_node = false;
+	bool in_edge = false;
+	bool in_data = false;
+
+	std::shared_ptr<DefaultKeyValues> const& defaults() {
+		if (!default_key_values) {
+			default_key_values = getDefaultKeys();
+			keys_missing = true;
+		}
+		return default_key_values;
 	}
 
-	auto nodes = parseNodes(node_result, default_key_values);
-	// we need to check for loopHead node due to different graph syntaxes
-	auto edges = parseEdges(edge_result, nodes, default_key_values);
-	auto data = parseData(graph_data_result);
-	auto aut = std::make_shared<WitnessAutomaton>(nodes, edges, data);
+	Node const& nodeTemplate() {
+		prepareTemplates();
+		return node_template;
+	}
 
-	return aut;
-}
+	Edge const& edgeTemplate() {
+		prepareTemplates();
+		return edge_template;
+	}
 
-std::shared_ptr<Data> parseData(pugi::xpath_node_set const& set) {
-	auto d = std::make_shared<Data>();
-	for (auto xpath_node: set) {
-		if (xpath_node.node() == nullptr) {
-			continue;
+	void prepareTemplates() {
+		if (!templates_valid) {
+			node_template = getDefaultNode(defaults());
+			edge_template = getDefaultEdge(defaults());
+			templates_valid = true;
 		}
-		auto attr = xpath_node.node().attribute("key");
-		if (attr.empty()) {
-			continue;
+	}
+
+	void startData(char const *name, Attributes const& attributes) {
+		char const *data_key_attr = findAttribute(attributes, "key");
+		in_data = strcmp(name, "data") == 0 && data_key_attr != nullptr;
+		if (in_data) {
+			data_key = data_key_attr;
 		}
-		const char *name = attr.value();
-		if (strcmp(name, "sourcecodelang") == 0) {
-			d->source_code_lang = xpath_node.node().text().get();
-		} else if (strcmp(name, "programfile") == 0) {
-			d->program_file = xpath_node.node().text().get();
-		} else if (strcmp(name, "programhash") == 0) {
-			d->program_hash = xpath_node.node().text().get();
-		} else if (strcmp(name, "specification") == 0) {
-			d->specification = xpath_node.node().text().get();
-		} else if (strcmp(name, "architecture") == 0) {
-			d->architecture = xpath_node.node().text().get();
-		} else if (strcmp(name, "producer") == 0) {
-			d->producer = xpath_node.node().text().get();
-		} else if (strcmp(name, "witness-type") == 0) {
-			d->witness_type = xpath_node.node().text().get();
+	}
+
+	void setEdgeAttribute(char const *name, char const *value) {
+		if (strcmp(name, "enterLoopHead") == 0) {
+			loop_head_given.back() = true;
 		}
+		setEdgeAttributes(edges.back(), name, value);
+	}
+};
+
+std::shared_ptr<WitnessAutomaton> WitnessAutomaton::automatonFromWitness(std::string const& filename) {
+	WitnessCacheEntry cache_entry = cacheEntryFor(filename);
+	auto cached = automatonFromCache(cache_entry);
+	if (cached) {
+		cw_verbose("Witness automaton loaded from %s\n", cache_entry.path.c_str());
+		return cached;
+	}
+
+	WitnessBuilder builder;
+	if (!parseGraphmlWitness(filename, builder)) {
+		return nullptr;
+	}
+	auto aut = builder.finish();
+	if (builder.isComplete()) {
+		aut->writeCache(cache_entry);
+	}
+	return aut;
+}
+
+void setDataAttributes(Data& data, char const *name, char const *value) {
+	if (strcmp(name, "sourcecodelang") == 0) {
+		data.source_code_lang = value;
+	} else if (strcmp(name, "programfile") == 0) {
+		data.program_file = value;
+	} else if (strcmp(name, "programhash") == 0) {
+		data.program_hash = value;
+	} else if (strcmp(name, "specification") == 0) {
+		data.specification = value;
+	} else if (strcmp(name, "architecture") == 0) {
+		data.architecture = value;
+	} else if (strcmp(name, "producer") == 0) {
+		data.producer = value;
+	} else if (strcmp(name, "witness-type") == 0) {
+		data.witness_type = value;
 	}
-	return d;
 }
 
 std::size_t stringToSizeT(std::string const& s) {
@@ -141,91 +350,133 @@ std::size_t stringToSizeT(char const* s) {
 	}
 }
 
-std::shared_ptr<Edge> getDefaultEdge(std::shared_ptr<DefaultKeyValues> const& def_values) {
-	auto e = std::make_shared<Edge>();
+Edge getDefaultEdge(std::shared_ptr<DefaultKeyValues> const& def_values) {
+	Edge e;
 
 	// strings
-	e->assumption = def_values->getDefault("assumption").default_val;
-	e->assumption_scope = def_values->getDefault("assumption.scope").default_val;
-	e->assumption_result_function = def_values->getDefault("assumption.resultfunction").default_val;
-	e->origin_file = def_values->getDefault("originfile").default_val;
+	e.assumption = def_values->getDefault("assumption").default_val;
+	e.assumption_scope = def_values->getDefault("assumption.scope").default_val;
+	e.assumption_result_function = def_values->getDefault("assumption.resultfunction").default_val;
+	e.origin_file = def_values->getDefault("originfile").default_val;
 //    e.source_id = def_values->getDefault("nodetype").default_val;
 //    e.target_id = def_values->getDefault("nodetype").default_val;
-	e->control = def_values->getDefault("control").default_val;
-	e->controlCondition = ConditionUndefined;
-	e->enter_function = def_values->getDefault("enterFunction").default_val;
-	e->return_from_function = def_values->getDefault("returnFrom").default_val;
-	e->source_code = def_values->getDefault("sourcecode").default_val;
+	e.control = def_values->getDefault("control").default_val;
+	e.controlCondition = ConditionUndefined;
+	e.enter_function = def_values->getDefault("enterFunction").default_val;
+	e.return_from_function = def_values->getDefault("returnFrom").default_val;
+	e.source_code = def_values->getDefault("sourcecode").default_val;
 
 	// bools - default value for all is false, so only if default is "true", shall it be true
-	e->enterLoopHead = (def_values->getDefault("enterLoopHead").default_val == "true");
+	e.enterLoopHead = (def_values->getDefault("enterLoopHead").default_val == "true");
 
 	// integers
-	e->start_line = stringToSizeT(def_values->getDefault("startline").default_val);
-	e->start_line = stringToSizeT(def_values->getDefault("endline").default_val);
-	e->start_offset = stringToSizeT(def_values->getDefault("startoffset").default_val);
-	e->end_offset = stringToSizeT(def_values->getDefault("endoffset").default_val);
+	e.start_line = stringToSizeT(def_values->getDefault("startline").default_val);
+	e.end_line = stringToSizeT(def_values->getDefault("endline").default_val);
+	e.start_offset = stringToSizeT(def_values->getDefault("startoffset").default_val);
+	e.end_offset = stringToSizeT(def_values->getDefault("endoffset").default_val);
 
 	return e;
 }
 
-std::string replace_equals(pugi::char_t const* value) {
-	std::string s(value);
-	s.replace(s.begin(), s.end(), "==", "= ");
-	return s;
+/* edges can't be copied for their compiled assumptions, but a default edge has none yet */
+Edge copyEdgeDefaults(Edge const& defaults) {
+	Edge e;
+	e.assumption = defaults.assumption;
+	e.assumption_scope = defaults.assumption_scope;
+	e.assumption_result_function = defaults.assumption_result_function;
+	e.origin_file = defaults.origin_file;
+	e.control = defaults.control;
+	e.controlCondition = defaults.controlCondition;
+	e.enter_function = defaults.enter_function;
+	e.return_from_function = defaults.return_from_function;
+	e.source_code = defaults.source_code;
+	e.enterLoopHead = defaults.enterLoopHead;
+	e.start_line = defaults.start_line;
+	e.end_line = defaults.end_line;
+	e.start_offset = defaults.start_offset;
+	e.end_offset = defaults.end_offset;
+	return e;
 }
 
-std::string fixAssumption(std::string a) {
-	static std::regex re("return_value_[^ =;]+", std::regex_constants::icase);
-
+std::string fixAssumption(char const *a) {
 	// CBMC and others use "return_value___VERIFIER_nondet_double = -1.0;" instead of "\result"...
-	a = std::regex_replace(a, re, R"(\result)");
+	// so every "return_value_" (in any case) followed by a name up to ' ', '=' or ';' becomes "\result"
+	static char const prefix[] = "return_value_";
+	static std::size_t const prefix_length = sizeof(prefix) - 1;
+
+	std::string fixed;
+	char const *copied = a;
+	for (char const *p = a; *p != '\0'; ++p) {
+		if (*p != 'r' && *p != 'R') {
+			continue;
+		}
+		std::size_t i = 0;
+		while (i < prefix_length && std::tolower(static_cast<unsigned char>(p[i])) == prefix[i]) {
+			++i;
+		}
+		char const *name = p + prefix_length;
+		if (i < prefix_length || *name == '\0' || strchr(" =;", *name) != nullptr) {
+			continue;
+		}
+		char const *end = name;
+		while (*end != '\0' && strchr(" =;", *end) == nullptr) {
+			++end;
+		}
+		fixed.append(copied, p);
+		fixed += "\\result";
+		copied = end;
+		p = end - 1;
+	}
+	if (copied == a) {
+		return a;
+	}
+	fixed += copied;
+	return fixed;
+}
 
-	return a;
+std::size_t findNodeIndex(std::map<std::string, std::size_t> const& nodeIds, char const *id) {
+	auto it = nodeIds.find(id);
+	return it == nodeIds.end() ? Node::invalid_index : it->second;
 }
 
-void setEdgeAttributes(std::shared_ptr<Edge>& edge, std::map<std::string, std::shared_ptr<Node>> const& nodes, pugi::char_t const* name, pugi::char_t const* value) {
+void setEdgeAttributes(Edge& edge, char const *name, char const *value) {
 	if (strcmp(name, "source") == 0) {
-		edge->source_id = value;
+		edge.source_id = value;
 	} else if (strcmp(name, "target") == 0) {
-		edge->target_id = value;
-		//check if we have an loopHead node
-		if (nodes.find(value) != nodes.end() && nodes.find(value)->second->is_loopHead) {
-			edge->enterLoopHead = true;
-		}
+		edge.target_id = value;
 	} else if (strcmp(name, "assumption") == 0) {
-		edge->assumption = fixAssumption(value);
+		edge.assumption = fixAssumption(value);
 	} else if (strcmp(name, "assumption.scope") == 0) {
-		edge->assumption_scope = value;
+		edge.assumption_scope = value;
 	} else if (strcmp(name, "assumption.resultfunction") == 0) {
-		edge->assumption_result_function = value;
+		edge.assumption_result_function = value;
 	} else if (strcmp(name, "originfile") == 0) {
-		edge->origin_file = value;
+		edge.origin_file = value;
 	} else if (strcmp(name, "control") == 0) {
-		edge->control = value;
+		edge.control = value;
 		if (strcmp(value, "condition-true") == 0) {
-			edge->controlCondition = ConditionTrue;
+			edge.controlCondition = ConditionTrue;
 		} else if (strcmp(value, "condition-false") == 0) {
-			edge->controlCondition = ConditionFalse;
+			edge.controlCondition = ConditionFalse;
 		} else {
-			edge->controlCondition = ConditionUndefined;
+			edge.controlCondition = ConditionUndefined;
 		}
 	} else if (strcmp(name, "startoffset") == 0) {
-		edge->start_offset = stringToSizeT(value);
+		edge.start_offset = stringToSizeT(value);
 	} else if (strcmp(name, "endoffset") == 0) {
-		edge->end_offset = stringToSizeT(value);
+		edge.end_offset = stringToSizeT(value);
 	} else if (strcmp(name, "startline") == 0) {
-		edge->start_line = stringToSizeT(value);
+		edge.start_line = stringToSizeT(value);
 	} else if (strcmp(name, "endline") == 0) {
-		edge->end_line = stringToSizeT(value);
+		edge.end_line = stringToSizeT(value);
 	} else if (strcmp(name, "enterFunction") == 0) {
-		edge->enter_function = value;
+		edge.enter_function = value;
 	} else if (strcmp(name, "returnFrom") == 0) {
-		edge->return_from_function = value;
+		edge.return_from_function = value;
 	} else if (strcmp(name, "sourcecode") == 0) {
-		edge->source_code = value;
+		edge.source_code = value;
 	} else if (strcmp(name, "enterLoopHead") == 0) {
-		edge->enterLoopHead = strcmp(value, "true") == 0;
+		edge.enterLoopHead = strcmp(value, "true") == 0;
 	} else if (strcmp(name, "threadId") != 0 && strcmp(name, "id") != 0) {
 #ifdef VERBOSE
 		std::cerr << " ### Unrecognized edge attribute definition: " << name << std::endl;
@@ -234,121 +485,61 @@ void setEdgeAttributes(std::shared_ptr<Edge>& edge, std::map<std::string, std::s
 }
 
 
-void parseEdgeProperties(pugi::xml_node const& node, std::map<std::string, std::shared_ptr<Node>> const& nodes, std::shared_ptr<Edge>& edge) {
-	for (auto child: node.children("data")) {
-		auto key = child.attribute("key");
-		if (!key.empty()) {
-			setEdgeAttributes(edge, nodes, key.value(), child.text().get());
-		}
-	}
-
+void fixEdgeProperties(Edge& edge) {
 	// Fix for VeriAbs being stupid
-	if (edge->assumption_result_function.rfind("__VERIFIER_nondet_", 0) == 0) {
+	if (edge.assumption_result_function.rfind("__VERIFIER_nondet_", 0) == 0) {
 		// Starts with __VERIFIER_nondet_
-		if (edge->assumption.rfind("result == ", 0) == 0) {
-			edge->assumption = "\\" + edge->assumption;
-		}
-	}
-}
-
-std::vector<std::shared_ptr<Edge>> parseEdges(pugi::xpath_node_set const& set, std::map<std::string, std::shared_ptr<Node>> const& graphNodes, std::shared_ptr<DefaultKeyValues> const& defaultKeyValues) {
-	auto edges = std::vector<std::shared_ptr<Edge>>();
-	edges.reserve(set.size());
-
-	for (auto xpathNode: set) {
-		if (!xpathNode.node()) {
-			continue;
-		}
-
-		auto e = getDefaultEdge(defaultKeyValues);
-		pugi::xml_node node = xpathNode.node();
-		for (auto attr: node.attributes()) {
-			setEdgeAttributes(e, graphNodes, attr.name(), attr.value());
-		}
-		parseEdgeProperties(node, graphNodes, e);
-
-		edges.push_back(e);
-	}
-
-	return edges;
-}
-
-void parseNodeProperties(pugi::xml_node const& node, std::shared_ptr<Node> const& n) {
-	for (auto child: node.children("data")) {
-		auto key = child.attribute("key");
-		if (!key.empty()) {
-			setNodeAttributes(n, key.value(), child.text().get());
-		}
-	}
-}
-
-std::map<std::string, std::shared_ptr<Node>> parseNodes(pugi::xpath_node_set const& set, std::shared_ptr<DefaultKeyValues> const& defaultKeyValues) {
-	auto nodes = std::map<std::string, std::shared_ptr<Node>>();
-
-	for (auto xpathNode: set) {
-		// check whether xpathNode is a node element
-		if (!xpathNode.node()) {
-			continue;
-		}
-
-		auto n = getDefaultNode(defaultKeyValues);
-		pugi::xml_node node = xpathNode.node();
-		for (auto attr: node.attributes()) {
-			setNodeAttributes(n, attr.name(), attr.value());
+		if (edge.assumption.rfind("result == ", 0) == 0) {
+			edge.assumption = "\\" + edge.assumption;
 		}
-		parseNodeProperties(node, n);
-
-		nodes.emplace(n->id, n);
 	}
-
-	return nodes;
 }
 
-std::shared_ptr<Node> getDefaultNode(std::shared_ptr<DefaultKeyValues> const& def_values) {
-	auto n = std::make_shared<Node>();
+Node getDefaultNode(std::shared_ptr<DefaultKeyValues> const& def_values) {
+	Node n;
 
 	// strings
-	n->invariant = def_values->getDefault("invariant").default_val;
-	n->invariant_scope = def_values->getDefault("invariant.scope").default_val;
-	n->node_type = def_values->getDefault("nodetype").default_val;
+	n.invariant = def_values->getDefault("invariant").default_val;
+	n.invariant_scope = def_values->getDefault("invariant.scope").default_val;
+	n.node_type = def_values->getDefault("nodetype").default_val;
 
 	// booleans - default value for all is false, so only if default is "true", shall it be true
-	n->is_frontier = (def_values->getDefault("frontier").default_val == "true");
-	n->is_violation = (def_values->getDefault("violation").default_val == "true");
-	n->is_entry = (def_values->getDefault("entry").default_val == "true");
-	n->is_sink = (def_values->getDefault("sink").default_val == "true");
-	n->is_loopHead = (def_values->getDefault("loopHead").default_val == "true");
+	n.is_frontier = (def_values->getDefault("frontier").default_val == "true");
+	n.is_violation = (def_values->getDefault("violation").default_val == "true");
+	n.is_entry = (def_values->getDefault("entry").default_val == "true");
+	n.is_sink = (def_values->getDefault("sink").default_val == "true");
+	n.is_loopHead = (def_values->getDefault("loopHead").default_val == "true");
 
 	// integers
 	std::string val = def_values->getDefault("thread").default_val;
-	n->thread_number = stringToSizeT(val);
+	n.thread_number = stringToSizeT(val);
 
 	return n;
 }
 
-void setNodeAttributes(std::shared_ptr<Node> const& node, char const* name, char const* value) {
+void setNodeAttributes(Node& node, char const* name, char const* value) {
 	if (strcmp(name, "id") == 0) {
-		node->id = value;
+		node.id = value;
 	} else if (strcmp(name, "entry") == 0) {
-		node->is_entry = (strcmp(value, "true") == 0);
+		node.is_entry = (strcmp(value, "true") == 0);
 	} else if (strcmp(name, "sink") == 0) {
-		node->is_sink = (strcmp(value, "true") == 0);
+		node.is_sink = (strcmp(value, "true") == 0);
 	} else if (strcmp(name, "frontier") == 0) {
-		node->is_frontier = (strcmp(value, "true") == 0);
+		node.is_frontier = (strcmp(value, "true") == 0);
 	} else if (strcmp(name, "loopHead") == 0) {
-		node->is_loopHead = (strcmp(value, "true") == 0);
+		node.is_loopHead = (strcmp(value, "true") == 0);
 	} else if (strcmp(name, "violation") == 0) {
-		node->is_violation = (strcmp(value, "true") == 0);
+		node.is_violation = (strcmp(value, "true") == 0);
 	} else if (strcmp(name, "violatedProperty") == 0) {
-		node->is_violation = true;
+		node.is_violation = true;
 	} else if (strcmp(name, "invariant") == 0) {
-		node->invariant = value;
+		node.invariant = value;
 	} else if (strcmp(name, "invariant.scope") == 0) {
-		node->invariant_scope = value;
+		node.invariant_scope = value;
 	} else if (strcmp(name, "nodetype") == 0) {
-		node->node_type = value;
+		node.node_type = value;
 	} else if (strcmp(name, "thread") == 0) {
-		node->thread_number = stringToSizeT(value);
+		node.thread_number = stringToSizeT(value);
 	} else {
 #ifdef VERBOSE
 		std::cerr << " ### Unrecognized node attribute definition: " << name << std::endl;
@@ -368,32 +559,6 @@ void setKeyAttributes(Key *key, const char *name, const char *value) {
 	}
 }
 
-std::shared_ptr<DefaultKeyValues> parseKeys(pugi::xpath_node_set const& keyNodeSet) {
-	auto dkv = std::make_unique<DefaultKeyValues>();
-
-	for (pugi::xpath_node xpath_node: keyNodeSet) {
-		if (!xpath_node.node()) {
-			continue;
-		}
-		pugi::xml_node node = xpath_node.node();
-		Key k;
-
-		for (auto attrIt: node.attributes()) {
-			setKeyAttributes(&k, attrIt.name(), attrIt.value());
-		}
-
-		pugi::xml_node cur = node.child("default");
-		if (cur) {
-			// has default value
-			k.default_val = cur.text().get();
-		}
-
-		dkv->addKey(k);
-	}
-
-	return dkv;
-}
-
 std::shared_ptr<DefaultKeyValues> getDefaultKeys() {
 	auto dkv = std::make_shared<DefaultKeyValues>();
 	dkv->addKey(Key("violatedProperty", "string", "node", "violatedProperty", ""));
@@ -428,10 +593,11 @@ void DefaultKeyValues::addKey(Key const& k) {
 	this->default_keys.emplace(k.id, k);
 }
 
-Key DefaultKeyValues::getDefault(std::string const& id) const {
+Key const& DefaultKeyValues::getDefault(std::string const& id) const {
+	static Key const no_key;
 	auto it = this->default_keys.find(id);
 	if (it == this->default_keys.end()) {
-		return Key();
+		return no_key;
 	}
 	return it->second;
 }
@@ -442,68 +608,105 @@ void DefaultKeyValues::print() const {
 	}
 }
 
-WitnessAutomaton::WitnessAutomaton(std::map<std::string, std::shared_ptr<Node>> const& nodes, std::vector<std::shared_ptr<Edge>> const& edges, std::shared_ptr<Data>& data) : nodes((nodes)), edges((edges)), data(*data), current_state(nullptr), successor_rel(), predecessor_rel() {
-	for (auto const& n: nodes) {
-		auto succ_set = std::set<std::shared_ptr<Edge>>();
-		successor_rel.emplace(n.first, succ_set);
-		auto pred_set = std::set<std::shared_ptr<Edge>>();
-		predecessor_rel.emplace(n.first, pred_set);
-
-		if (n.second->is_entry) {
-			current_state = n.second;
+WitnessAutomaton::WitnessAutomaton(std::vector<Node>&& nodes, std::vector<Edge>&& edges, std::shared_ptr<Data>& data) : nodes(std::move(nodes)), edges(), data(*data) {
+	for (std::size_t n = 0; n < this->nodes.size(); ++n) {
+		if (this->nodes[n].is_entry) {
+			current_state = n;
+		}
+		if (this->nodes[n].id == "sink") {
+			sink_state = n;
 		}
 	}
-	if (current_state == nullptr) {
+	if (current_state == Node::invalid_index) {
 		std::cerr << "There seems to be no entry state to the witness automaton! Aborting validation." << std::endl;
 		this->illegal_state = true;
 		return;
 	}
-	for (auto const& trans: edges) {
-		auto src = nodes.find(trans->source_id);
-		if (src == nodes.end()) {
-			std::cerr << "WARN: Did not find source node '" << trans->source_id << "', skipping." << std::endl;
+
+	// count the edges per source node, then lay them out grouped by source, keeping file order within a group
+	successor_offsets.assign(this->nodes.size() + 1, 0);
+	predecessor_offsets.assign(this->nodes.size() + 1, 0);
+	for (auto& trans: edges) {
+		if (trans.source == Node::invalid_index) {
+			std::cerr << "WARN: Did not find source node '" << trans.source_id << "', skipping." << std::endl;
 			continue;
 		}
-		auto tar = nodes.find(trans->target_id);
-		if (tar == nodes.end()) {
-			std::cerr << "WARN: Did not find target node '" << trans->target_id << "', skipping." << std::endl;
+		if (trans.target == Node::invalid_index) {
+			std::cerr << "WARN: Did not find target node '" << trans.target_id << "', skipping." << std::endl;
 			continue;
 		}
+		++successor_offsets[trans.source + 1];
+		++predecessor_offsets[trans.target + 1];
+	}
+	for (std::size_t n = 0; n < this->nodes.size(); ++n) {
+		successor_offsets[n + 1] += successor_offsets[n];
+		predecessor_offsets[n + 1] += predecessor_offsets[n];
+	}
 
-		// fix startline, endline
-		if (trans->end_line == 0) {
-			trans->end_line = trans->start_line;
-//            fprintf(stderr, "No endline definition for %s --> %s. Set to: %d\n", trans->source_id.c_str(), trans->target_id.c_str(), trans->start_line);
+	// the slots are handed out in file order, then the edges are prepared and moved to them on all threads
+	predecessor_edges.resize(predecessor_offsets.back());
+	std::vector<std::size_t> slots(edges.size(), Node::invalid_index);
+	std::vector<std::size_t> next_successor(successor_offsets.begin(), successor_offsets.end() - 1);
+	std::vector<std::size_t> next_predecessor(predecessor_offsets.begin(), predecessor_offsets.end() - 1);
+	for (std::size_t e = 0; e < edges.size(); ++e) {
+		Edge const& trans = edges[e];
+		if (trans.source == Node::invalid_index || trans.target == Node::invalid_index) {
+			continue;
 		}
-
-		auto& node_successors = successor_rel.find(trans->source_id)->second;
-		node_successors.insert(trans);
-		auto& node_predecessors = predecessor_rel.find(trans->target_id)->second;
-		node_predecessors.insert(trans);
+		slots[e] = next_successor[trans.source]++;
+		predecessor_edges[next_predecessor[trans.target]++] = slots[e];
 	}
+
+	this->edges.resize(successor_offsets.back());
+	forEachRange(edges.size(), [this, &edges, &slots](std::size_t first, std::size_t last) {
+		for (std::size_t e = first; e < last; ++e) {
+			if (slots[e] == Node::invalid_index) {
+				continue;
+			}
+			Edge& trans = edges[e];
+			trans.prepareAssumptions();
+
+			// fix startline, endline
+			if (trans.end_line == 0) {
+				trans.end_line = trans.start_line;
+//            fprintf(stderr, "No endline definition for %s --> %s. Set to: %d\n", trans.source_id.c_str(), trans.target_id.c_str(), trans.start_line);
+			}
+			this->edges[slots[e]] = std::move(trans);
+		}
+	});
+	buildSuccessorIndex();
 }
 
 WitnessAutomaton::WitnessAutomaton() {
-	std::shared_ptr<Node> n = std::make_shared<Node>();
-	n->id = "node";
-	n->is_entry = true;
-	n->is_violation = false;
-	nodes.insert(std::make_pair("node", n));
-	auto e = std::make_shared<Edge>();
-	e->start_line = 1;
-	e->end_line = -1ul;
-	e->source_id = "node";
-	e->target_id = "node";
-
-	current_state = n;
-
-	auto succ_set = std::set<std::shared_ptr<Edge>>();
-	succ_set.insert(e);
-	successor_rel.emplace(n->id, succ_set);
-	auto pred_set = std::set<std::shared_ptr<Edge>>();
-	pred_set.insert(e);
-	predecessor_rel.emplace(n->id, pred_set);
-
+	Node n;
+	n.id = "node";
+	n.is_entry = true;
+	n.is_violation = false;
+	nodes.push_back(std::move(n));
+	Edge e;
+	e.start_line = 1;
+	e.end_line = -1ul;
+	e.source_id = "node";
+	e.target_id = "node";
+	e.source = 0;
+	e.target = 0;
+	edges.push_back(std::move(e));
+
+	current_state = 0;
+
+	successor_offsets = {0, 1};
+	predecessor_offsets = {0, 1};
+	predecessor_edges = {0};
+	buildSuccessorIndex();
+}
+
+void WitnessAutomaton::buildSuccessorIndex() {
+	successor_index.assign(nodes.size(), EdgeLineIndex());
+	forEachRange(nodes.size(), [this](std::size_t first, std::size_t last) {
+		for (std::size_t n = first; n < last; ++n) {
+			successor_index[n].build(edges.data() + successor_offsets[n], edges.data() + successor_offsets[n + 1]);
+		}
+	});
 }
 
 void WitnessAutomaton::printData() const {
@@ -511,19 +714,19 @@ void WitnessAutomaton::printData() const {
 }
 
 void WitnessAutomaton::printRelations() const {
-	std::cout << "Successor relation (" << successor_rel.size() << "):" << std::endl;
-	for (auto const& n: successor_rel) {
-		std::cout << n.first << "\t ----> \t";
-		for (auto const& s: n.second) {
-			std::cout << s->target_id << ", ";
+	std::cout << "Successor relation (" << nodes.size() << "):" << std::endl;
+	for (std::size_t n = 0; n < nodes.size(); ++n) {
+		std::cout << nodes[n].id << "\t ----> \t";
+		for (std::size_t e = successor_offsets[n]; e < successor_offsets[n + 1]; ++e) {
+			std::cout << edges[e].target_id << ", ";
 		}
 		std::cout << std::endl;
 	}
-	std::cout << "Predecessor relation (" << predecessor_rel.size() << "):" << std::endl;
-	for (auto const& n: predecessor_rel) {
-		std::cout << n.first << "\t <---- \t";
-		for (auto const& s: n.second) {
-			std::cout << s->source_id << ", ";
+	std::cout << "Predecessor relation (" << nodes.size() << "):" << std::endl;
+	for (std::size_t n = 0; n < nodes.size(); ++n) {
+		std::cout << nodes[n].id << "\t <---- \t";
+		for (std::size_t e = predecessor_offsets[n]; e < predecessor_offsets[n + 1]; ++e) {
+			std::cout << edges[predecessor_edges[e]].source_id << ", ";
 		}
 		std::cout << std::endl;
 	}
@@ -534,15 +737,15 @@ bool WitnessAutomaton::isInIllegalState() const {
 }
 
 bool WitnessAutomaton::isInViolationState() const {
-	return (current_state != nullptr) && current_state->is_violation;
+	return (current_state != Node::invalid_index) && nodes[current_state].is_violation;
 }
 
 bool WitnessAutomaton::isInSinkState() const {
-	return (current_state != nullptr) && current_state->is_sink;
+	return (current_state != Node::invalid_index) && nodes[current_state].is_sink;
 }
 
-std::shared_ptr<Node> const& WitnessAutomaton::getCurrentState() const {
-	return this->current_state;
+Node const& WitnessAutomaton::getCurrentState() const {
+	return nodes[current_state];
 }
 
 bool WitnessAutomaton::wasVerifierErrorCalled() const {
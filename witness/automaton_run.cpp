@@ -34,102 +34,155 @@ std::vector<std::string> split(std::string const& str, char delimiter) {
 	return result;
 }
 
-bool satisfiesAssumptionsAndResolve(ParseState *state, const std::shared_ptr<Edge>& edge) {
-	auto assumptions = split(edge->assumption, ';');
+CompiledAssumption::CompiledAssumption(CompiledAssumption&& other) noexcept : text(std::move(other.text)), pc(other.pc), tokens(other.tokens),
+		reg_file_name(other.reg_file_name), is_lexed(other.is_lexed), lex_failed(other.lex_failed),
+		is_result_assumption(other.is_result_assumption), has_result_value(other.has_result_value),
+		result_type(other.result_type), result_value(other.result_value) {
+	other.tokens = nullptr;
+	other.reset();
+}
 
-	for (std::string const& ass: assumptions) {
-		if (ass.empty()) {
-			continue;
+// the tokens are left to the interpreter's heap, which releases them in PicocCleanup()
+void CompiledAssumption::reset() {
+	tokens = nullptr;
+	pc = nullptr;
+	reg_file_name = nullptr;
+	is_lexed = false;
+	lex_failed = false;
+	is_result_assumption = false;
+	has_result_value = false;
+	result_type = nullptr;
+}
+
+void Edge::prepareAssumptions() {
+	compiled_assumptions.clear();
+	for (std::string& ass: split(assumption, ';')) {
+		if (!ass.empty()) {
+			compiled_assumptions.emplace_back(std::move(ass));
+		}
+	}
+}
+
+// Lexes the assumption and looks for the "\result == <const>" form, the constant is folded (sign, NaN) once here.
+// Must be called in assumption mode, lexing errors jump to the AssumptionPicocExitBuf.
+void lexAssumption(ParseState *state, CompiledAssumption& ca) {
+	ca.reset();
+	ca.pc = state->pc;
+	ca.lex_failed = true;
+	std::string file_name = "assumption " + ca.text;
+	ca.reg_file_name = nitwit::table::TableStrRegister(state->pc, file_name.c_str(), file_name.length());
+	char* ResultString = nitwit::table::TableStrRegister(state->pc, "result");
+	char* NaNString = nitwit::table::TableStrRegister(state->pc, "nan");
+
+	ca.tokens = nitwit::lex::LexAnalyse(state->pc, ca.reg_file_name, ca.text.c_str(), ca.text.length(), nullptr);
+	ca.lex_failed = false;
+	ca.is_lexed = true;
+
+	ParseState Parser{};
+	nitwit::lex::LexInitParser(&Parser, state->pc, ca.text.c_str(), ca.tokens, ca.reg_file_name, TRUE, FALSE, nullptr);
+	Value *value = nullptr;
+	LexToken token = nitwit::lex::LexGetToken(&Parser, &value, false);
+	ca.is_result_assumption = token == TokenWitnessResult ||
+			// hack for VeriAbs - it outputs 'result' instead of '\result'
+			(token == TokenIdentifier && value->Val->Identifier == ResultString);
+	if (!ca.is_result_assumption) {
+		return;
+	}
+
+	while (token != TokenEOF) {
+		token = nitwit::lex::LexGetToken(&Parser, nullptr, false);
+		if ((!(token >= TokenIntegerConstant && token <= TokenCharacterConstant) &&
+			 token != TokenMinus)) {
+			token = nitwit::lex::LexGetToken(&Parser, nullptr, true);
+		} else {
+			break;
+		}
+	}
+	bool positive = true;
+	if (nitwit::lex::LexGetToken(&Parser, nullptr, false) == TokenMinus) {
+		nitwit::lex::LexGetToken(&Parser, nullptr, true);
+		positive = false;
+	}
+	token = nitwit::lex::LexGetToken(&Parser, &value, true);
+	if (value == nullptr) {
+		return;
+	}
+	ca.result_type = value->Typ;
+	ca.result_value = *value->Val;
+
+	// In case we read a "NaN", we need to fix this here
+	if (token == TokenIdentifier && (ca.result_value.Identifier != nullptr) && (strcmpi(ca.result_value.Identifier, NaNString) == 0)) {
+		ca.result_type = &(Parser.pc->DoubleType);
+		ca.result_value.Double = std::numeric_limits<double>::quiet_NaN();
+	}
+	if (ca.result_type == nullptr) {
+		// any other identifier has no value we could assign
+		return;
+	}
+
+	if (!positive) {
+		switch (ca.result_type->Base) {
+			case BaseType::TypeDouble:
+				ca.result_value.Double = -ca.result_value.Double;
+				break;
+			case BaseType::TypeChar:
+				ca.result_value.Character = -ca.result_value.Character;
+				break;
+			case BaseType::TypeLong:
+				ca.result_value.LongInteger = -ca.result_value.LongInteger;
+				break;
+			case BaseType::TypeUnsignedLong:
+				ca.result_value.UnsignedLongInteger = -ca.result_value.UnsignedLongInteger;
+				break;
+			case BaseType::TypeLongLong:
+				ca.result_value.LongLongInteger = -ca.result_value.LongLongInteger;
+				break;
+			case BaseType::TypeUnsignedLongLong:
+				ca.result_value.UnsignedLongLongInteger = -ca.result_value.UnsignedLongLongInteger;
+				break;
+			default:
+				fprintf(stderr, "Type not found in parsing constant from assumption.\n");
+				break;
 		}
+	}
+	ca.has_result_value = true;
+}
+
+bool satisfiesAssumptionsAndResolve(ParseState *state, Edge *edge) {
+	for (CompiledAssumption& ca: edge->compiled_assumptions) {
 #ifdef VERBOSE
-		std::cout << "Working on assumption '" << ass << "'..." << std::endl;
+		std::cout << "Working on assumption '" << ca.text << "'..." << std::endl;
 #endif
 
-		void *heapstacktop_before = state->pc->HeapStackTop;
-		unsigned char *heapmemory_before = state->pc->HeapMemory;
-		void *heapbottom_before = state->pc->HeapBottom;
-		void *stackframe = state->pc->StackFrame;
-		HeapInit(state->pc, 1048576); // 1 MB
-		char* RegFileName = nitwit::table::TableStrRegister(state->pc, ("assumption " + ass).c_str());
-		char* ResultString = nitwit::table::TableStrRegister(state->pc, "result");
-		char* NaNString = nitwit::table::TableStrRegister(state->pc, "nan");
+		HeapEnterAssumptionStack(state->pc);
 
-		void *Tokens = nullptr;
 		if (setjmp(state->pc->AssumptionPicocExitBuf)) {
 			cw_verbose("Stopping assumption checker.\n");
-			free(Tokens);
 
-			HeapCleanup(state->pc);
-			state->pc->HeapStackTop = heapstacktop_before;
-			state->pc->HeapMemory = heapmemory_before;
-			state->pc->HeapBottom = heapbottom_before;
-			state->pc->StackFrame = stackframe;
+			HeapLeaveAssumptionStack(state->pc);
 			return false;
 		}
 
-		// initialize tokens and parser for assumption checking
-		Tokens = nitwit::lex::LexAnalyse(state->pc, RegFileName, ass.c_str(), ass.length(), nullptr);
+		// the tokens only live as long as the interpreter that interned their identifiers
+		if (!ca.is_lexed || ca.pc != state->pc) {
+			if (ca.lex_failed && ca.pc == state->pc) {
+				PlatformExit(state->pc, 1);
+			}
+			lexAssumption(state, ca);
+		}
+
 		ParseState Parser{};
-		nitwit::lex::LexInitParser(&Parser, state->pc, ass.c_str(), Tokens, RegFileName, TRUE, FALSE, nullptr);
+		nitwit::lex::LexInitParser(&Parser, state->pc, ca.text.c_str(), ca.tokens, ca.reg_file_name, TRUE, FALSE, nullptr);
 		int ret = 0;
-		Value *value = nullptr;
 
-		if (state->SkipIntrinsic && state->LastNonDetValue != nullptr &&
-			(nitwit::lex::LexGetToken(&Parser, &value, false) == TokenWitnessResult ||
-			 (value != nullptr && strcmp(value->Val->Identifier, ResultString) == 0)
-					// hack for VeriAbs - it outputs 'result' instead of '\result'
-			)) {
+		if (state->SkipIntrinsic && state->LastNonDetValue != nullptr && ca.is_result_assumption) {
 			// handling \result in witnesses
-			LexToken token = TokenNone;
-			while (token != TokenEOF) {
-				token = nitwit::lex::LexGetToken(&Parser, nullptr, false);
-				if ((!(token >= TokenIntegerConstant && token <= TokenCharacterConstant) &&
-					 token != TokenMinus)) {
-					token = nitwit::lex::LexGetToken(&Parser, nullptr, true);
-				} else {
-					break;
-				}
-			}
-			bool positive = true;
-			if (nitwit::lex::LexGetToken(&Parser, nullptr, false) == TokenMinus) {
-				nitwit::lex::LexGetToken(&Parser, nullptr, true);
-				positive = false;
-			}
-			token = nitwit::lex::LexGetToken(&Parser, &value, true);
-			if (value != nullptr) {
-				// In case we read a "NaN", we need to fix this here
-				if (token == TokenIdentifier && (value->Val != nullptr) && (value->Val->Identifier != nullptr) && (strcmpi(value->Val->Identifier, NaNString) == 0)) {
-					value->Typ = &(Parser.pc->DoubleType);
-					value->Val->Double = std::numeric_limits<double>::quiet_NaN();
-				}
-
-				if (!positive) {
-					switch (value->Typ->Base) {
-						case BaseType::TypeDouble:
-							value->Val->Double = -value->Val->Double;
-							break;
-						case BaseType::TypeChar:
-							value->Val->Character = -value->Val->Character;
-							break;
-						case BaseType::TypeLong:
-							value->Val->LongInteger = -value->Val->LongInteger;
-							break;
-						case BaseType::TypeUnsignedLong:
-							value->Val->UnsignedLongInteger = -value->Val->UnsignedLongInteger;
-							break;
-						case BaseType::TypeLongLong:
-							value->Val->LongLongInteger = -value->Val->LongLongInteger;
-							break;
-						case BaseType::TypeUnsignedLongLong:
-							value->Val->UnsignedLongLongInteger = -value->Val->UnsignedLongLongInteger;
-							break;
-						default:
-							fprintf(stderr, "Type not found in parsing constant from assumption.\n");
-							break;
-					}
-				}
+			if (ca.has_result_value) {
+				Value value{};
+				value.Typ = ca.result_type;
+				value.Val = &ca.result_value;
 				state->LastNonDetValue->Typ = TypeGetDeterministic(state, state->LastNonDetValue->Typ);
-				nitwit::assumptions::ExpressionAssign(&Parser, state->LastNonDetValue, value, TRUE, nullptr, 0, TRUE);
+				nitwit::assumptions::ExpressionAssign(&Parser, state->LastNonDetValue, &value, TRUE, nullptr, 0, TRUE);
 				state->LastNonDetValue = nullptr;
 				ret = 1;
 			}
@@ -138,12 +191,7 @@ bool satisfiesAssumptionsAndResolve(ParseState *state, const std::shared_ptr<Edg
 		} else {
 			ret = nitwit::assumptions::ExpressionParseLongLong(&Parser);
 		}
-		free(Tokens);
-		HeapCleanup(state->pc);
-		state->pc->HeapStackTop = heapstacktop_before;
-		state->pc->HeapMemory = heapmemory_before;
-		state->pc->HeapBottom = heapbottom_before;
-		state->pc->StackFrame = stackframe;
+		HeapLeaveAssumptionStack(state->pc);
 
 		ValueList *Next = Parser.ResolvedNonDetVars;
 		for (ValueList *I = Next; I != nullptr; I = Next) {
@@ -168,7 +216,7 @@ bool satisfiesAssumptionsAndResolve(ParseState *state, const std::shared_ptr<Edg
 		}
 
 #ifdef VERBOSE
-		std::cout << "Work on assumption '" << ass << "' done." << std::endl;
+		std::cout << "Work on assumption '" << ca.text << "' done." << std::endl;
 #endif
 
 		if (!ret) {
@@ -179,20 +227,96 @@ bool satisfiesAssumptionsAndResolve(ParseState *state, const std::shared_ptr<Edg
 	return true;
 }
 
+void EdgeLineIndex::build(Edge *first, Edge *last) {
+	by_start_line.clear();
+	wildcards.clear();
+	irregular.clear();
+
+	std::size_t rank = 0;
+	for (Edge *edge = first; edge != last; ++edge) {
+		Entry entry{edge->start_line, edge->end_line, edge->end_line, rank++, edge};
+		if (edge->start_line == 0 && edge->end_line == 0) {
+			wildcards.push_back(entry);
+		} else if (edge->end_line < edge->start_line) {
+			irregular.push_back(entry);
+		} else {
+			by_start_line.push_back(entry);
+		}
+	}
+	std::sort(by_start_line.begin(), by_start_line.end(), [](Entry const& a, Entry const& b) {
+		return a.start_line < b.start_line;
+	});
+	buildSubtree(0, by_start_line.size());
+}
+
+std::size_t EdgeLineIndex::buildSubtree(std::size_t lo, std::size_t hi) {
+	if (lo >= hi) {
+		return 0;
+	}
+	std::size_t mid = lo + (hi - lo) / 2;
+	Entry& entry = by_start_line[mid];
+	entry.max_end_line = std::max({entry.end_line, buildSubtree(lo, mid), buildSubtree(mid + 1, hi)});
+	return entry.max_end_line;
+}
+
+// Reports all entries with start_line <= line <= end_line.
+void EdgeLineIndex::stab(std::size_t lo, std::size_t hi, std::size_t line, std::vector<Entry const*>& out) const {
+	while (lo < hi) {
+		std::size_t mid = lo + (hi - lo) / 2;
+		Entry const& entry = by_start_line[mid];
+		if (entry.max_end_line < line) {
+			return;
+		}
+		stab(lo, mid, line, out);
+		if (line < entry.start_line) {
+			// everything right of mid starts even later
+			return;
+		}
+		if (line <= entry.end_line) {
+			out.push_back(&entry);
+		}
+		lo = mid + 1;
+	}
+}
+
+void EdgeLineIndex::candidates(std::size_t line, bool isMultiLineDeclaration, std::size_t endLine, std::vector<Entry const*>& out) const {
+	out.clear();
+	stab(0, by_start_line.size(), line, out);
+	if (isMultiLineDeclaration) {
+		// edges lying completely within the lines of the declaration
+		auto it = std::lower_bound(by_start_line.begin(), by_start_line.end(), line, [](Entry const& entry, std::size_t l) {
+			return entry.start_line < l;
+		});
+		for (; it != by_start_line.end() && it->start_line <= endLine; ++it) {
+			if (it->end_line <= endLine) {
+				out.push_back(&*it);
+			}
+		}
+	}
+	for (Entry const& entry: irregular) {
+		if (isMultiLineDeclaration && line <= entry.start_line && entry.end_line <= endLine) {
+			out.push_back(&entry);
+		}
+	}
+	for (Entry const& entry: wildcards) {
+		out.push_back(&entry);
+	}
+
+	std::sort(out.begin(), out.end(), [](Entry const* a, Entry const* b) {
+		return a->rank < b->rank;
+	});
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
 bool WitnessAutomaton::canTransitionFurther() {
-	if (current_state == nullptr || this->isInIllegalState()) {
+	if (current_state == Node::invalid_index || this->isInIllegalState()) {
 		this->illegal_state = true;
 		return false;
 	}
-	if (current_state->is_violation || current_state->is_sink) {
+	if (nodes[current_state].is_violation || nodes[current_state].is_sink) {
 		// don't do anything once we have reached violation or sink
 		return false;
 	}
-	const auto& succs = successor_rel.find(current_state->id);
-	if (succs == successor_rel.end()) { // state isn't sink
-		this->illegal_state = true;
-		return false;
-	}
 	return true;
 }
 
@@ -230,20 +354,14 @@ bool WitnessAutomaton::consumeState(ParseState *state, bool isMultiLineDeclarati
 
 	bool could_go_to_sink = false;
 	state->pc->IsInAssumptionMode = TRUE;
-	for (auto const& edge: successor_rel.find(current_state->id)->second) {
+	successor_index[current_state].candidates(state->Line, isMultiLineDeclaration, endLine, candidate_buffer);
+	for (EdgeLineIndex::Entry const* candidate: candidate_buffer) {
+		Edge *edge = candidate->edge;
 #ifdef REQUIRE_MATCHING_ORIGINFILENAME
 		if (!edge->origin_file.empty() && baseFileName(edge->origin_file) != baseFileName(string(state->FileName))) {
 			continue;
 		}
 #endif
-		if (!((edge->start_line <= state->Line && (state->Line <= edge->end_line)) || (isMultiLineDeclaration && state->Line <= edge->start_line && edge->end_line <= endLine))) {
-			if (!(edge->start_line == 0 && edge->end_line == 0)) {
-#ifdef DEBUG_WITNESS_EDGES
-				cw_verbose("Edge line constraints do not match, !((start_line = %zu <= %zu and %zu <= %zu = end_line) or (isMultiLineDeclaration = %i and state->Line = %zu <= %zu = start_line && end_line = %zu <= %zu = endLine)) for assumption '%s'.\n", edge->start_line, state->Line, state->Line, edge->end_line, isMultiLineDeclaration ? 1 : 0, state->Line, edge->start_line, edge->end_line, endLine, edge->assumption.c_str());
-#endif
-				continue;
-			}
-		}
 
 		// Check that we were not working on the same line
 		if (lastLineUsedValid && (edge->start_line == edge->end_line) && (edge->start_line == lastLineUsed)) {
@@ -258,10 +376,10 @@ bool WitnessAutomaton::consumeState(ParseState *state, bool isMultiLineDeclarati
 
 		// check assumption
 		cw_verbose("About to check assumption '%s'.\n", edge->assumption.c_str());
-		if (!edge->assumption.empty() && !satisfiesAssumptionsAndResolve(state, edge)) {
+		if (!edge->compiled_assumptions.empty() && !satisfiesAssumptionsAndResolve(state, edge)) {
 			cw_verbose("Unmet assumption '%s'.\n", edge->assumption.c_str());
 			continue;
-		} else if (!edge->assumption.empty()) {
+		} else if (!edge->compiled_assumptions.empty()) {
 			cw_verbose("Assumption '%s' satisfied.\n", edge->assumption.c_str());
 		}
 
@@ -288,13 +406,13 @@ bool WitnessAutomaton::consumeState(ParseState *state, bool isMultiLineDeclarati
 			}
 		}
 
-		if (edge->target_id == "sink") {
+		if (edge->target == sink_state) {
 			could_go_to_sink = true;
 			continue;
 			// prefer to follow through to other edges than sink,
 			// but if nothing else is possible, take it
 		}
-		current_state = nodes.find(edge->target_id)->second;
+		current_state = edge->target;
 		cw_verbose("\tTaking edge: %s --> %s\n", edge->source_id.c_str(), edge->target_id.c_str());
 		state->pc->IsInAssumptionMode = FALSE;
 		unsuccessfulTries = 0; // reset counter
@@ -306,8 +424,8 @@ bool WitnessAutomaton::consumeState(ParseState *state, bool isMultiLineDeclarati
 	}
 
 	if (could_go_to_sink) {
-		cw_verbose("\tTaking edge: %s --> sink\n", current_state->id.c_str());
-		current_state = nodes.find("sink")->second;
+		cw_verbose("\tTaking edge: %s --> sink\n", nodes[current_state].id.c_str());
+		current_state = sink_state;
 		state->pc->IsInAssumptionMode = FALSE;
 		return true;
 	}
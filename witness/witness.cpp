@@ -3,33 +3,609 @@
 //
 
 #include "witness.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#ifdef WITNESS_GZIP
+#include <zlib.h>
+#endif
+#ifdef WITNESS_ZSTD
+#include <zstd.h>
+#endif
 
-std::shared_ptr<pugi::xml_document> parseGraphmlWitness(std::string const& filename) {
-    if (filename.empty()) {
-        std::cerr << "No witness file name provided." << std::endl;
-        return nullptr;
+namespace {
+
+constexpr std::size_t witness_chunk_size = 1 << 16;
+
+/* the bytes of the witness file, decompressed while they are read if the file starts like a gzip or zstd stream */
+class WitnessReader {
+public:
+    explicit WitnessReader(FILE *file) : file(file), raw(witness_chunk_size) {
+        fillRaw();
+        if (raw_size >= 2 && memcmp(raw.data(), "\x1F\x8B", 2) == 0) {
+#ifdef WITNESS_GZIP
+            format = Gzip;
+            // 16 + the largest window: a gzip header and trailer instead of a zlib one
+            if (inflateInit2(&gzip, 16 + MAX_WBITS) != Z_OK) {
+                fail("Could not start decompressing the witness");
+            }
+#else
+            fail("Witness is compressed with gzip, which this build can't read");
+#endif
+        } else if (raw_size >= 4 && memcmp(raw.data(), "\x28\xB5\x2F\xFD", 4) == 0) {
+#ifdef WITNESS_ZSTD
+            format = Zstd;
+            zstd = ZSTD_createDStream();
+            if (zstd == nullptr) {
+                fail("Could not start decompressing the witness");
+            }
+#else
+            fail("Witness is compressed with zstd, which this build can't read");
+#endif
+        }
+    }
+
+    ~WitnessReader() {
+#ifdef WITNESS_GZIP
+        if (format == Gzip) {
+            inflateEnd(&gzip);
+        }
+#endif
+#ifdef WITNESS_ZSTD
+        ZSTD_freeDStream(zstd);
+#endif
+    }
+
+    WitnessReader(WitnessReader const&) = delete;
+    WitnessReader& operator=(WitnessReader const&) = delete;
+
+    /* fills out with up to size bytes of the witness, returns how many. 0 at its end or after an error */
+    std::size_t read(char *out, std::size_t size) {
+        if (error != nullptr || finished || size == 0) {
+            return 0;
+        }
+        switch (format) {
+#ifdef WITNESS_GZIP
+            case Gzip:
+                return readGzip(out, size);
+#endif
+#ifdef WITNESS_ZSTD
+            case Zstd:
+                return readZstd(out, size);
+#endif
+            default:
+                return readPlain(out, size);
+        }
+    }
+
+    /* nullptr or why the witness could not be read to its end */
+    char const *failure() const { return error; }
+
+private:
+    enum Format {
+        Plain, Gzip, Zstd
+    };
+
+    FILE *file;
+    Format format = Plain;
+    std::vector<char> raw;                      /* read from the file, but not decompressed yet */
+    std::size_t raw_first = 0;
+    std::size_t raw_size = 0;
+    bool stream_open = false;                   /* within a gzip member or zstd frame */
+    bool output_pending = false;                /* the last call filled the output, the decoder may hold more */
+    bool finished = false;                      /* only trailing garbage is left */
+    char const *error = nullptr;
+#ifdef WITNESS_GZIP
+    z_stream gzip{};
+#endif
+#ifdef WITNESS_ZSTD
+    ZSTD_DStream *zstd = nullptr;
+#endif
+
+    void fail(char const *why) {
+        if (error == nullptr) {
+            error = why;
+        }
+    }
+
+    /* reads the next piece of the file once all of the last one is used. returns false at its end */
+    bool fillRaw() {
+        if (raw_first < raw_size) {
+            return true;
+        }
+        raw_first = 0;
+        raw_size = fread(raw.data(), 1, raw.size(), file);
+        if (ferror(file) != 0) {
+            fail("Could not read file");
+        }
+        return raw_size > 0;
+    }
+
+    std::size_t readPlain(char *out, std::size_t size) {
+        if (raw_first < raw_size) {
+            std::size_t n = std::min(size, raw_size - raw_first);
+            memcpy(out, raw.data() + raw_first, n);
+            raw_first += n;
+            return n;
+        }
+        std::size_t n = fread(out, 1, size, file);
+        if (ferror(file) != 0) {
+            fail("Could not read file");
+        }
+        return n;
+    }
+
+    /* the end of the input is only the end of the witness between two streams, otherwise it was cut short */
+    bool needInput() {
+        if (output_pending || fillRaw()) {
+            return true;
+        }
+        if (stream_open) {
+            fail("Compressed witness ends unexpectedly");
+        }
+        return false;
+    }
+
+#ifdef WITNESS_GZIP
+    std::size_t readGzip(char *out, std::size_t size) {
+        std::size_t produced = 0;
+        while (produced < size && error == nullptr && needInput()) {
+            if (!stream_open) {
+                // another member may follow, anything else behind the last one is ignored like gzip does
+                if (!fillRaw() || static_cast<unsigned char>(raw[raw_first]) != 0x1F) {
+                    finished = true;
+                    break;
+                }
+                inflateReset(&gzip);
+                stream_open = true;
+            }
+            gzip.next_in = reinterpret_cast<Bytef *>(raw.data() + raw_first);
+            gzip.avail_in = static_cast<uInt>(raw_size - raw_first);
+            gzip.next_out = reinterpret_cast<Bytef *>(out + produced);
+            gzip.avail_out = static_cast<uInt>(size - produced);
+            int status = inflate(&gzip, Z_NO_FLUSH);
+            raw_first = raw_size - gzip.avail_in;
+            produced = size - gzip.avail_out;
+            output_pending = gzip.avail_out == 0;
+            if (status == Z_STREAM_END) {
+                stream_open = false;
+            } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                fail("Corrupt gzip data in witness");
+            }
+        }
+        return produced;
+    }
+#endif
+
+#ifdef WITNESS_ZSTD
+    std::size_t readZstd(char *out, std::size_t size) {
+        ZSTD_outBuffer output{out, size, 0};
+        while (output.pos < size && error == nullptr && needInput()) {
+            ZSTD_inBuffer input{raw.data(), raw_size, raw_first};
+            std::size_t status = ZSTD_decompressStream(zstd, &output, &input);
+            raw_first = input.pos;
+            output_pending = output.pos == size;
+            if (ZSTD_isError(status)) {
+                fail("Corrupt zstd data in witness");
+            } else {
+                // 0 once a frame is complete, a new one may follow
+                stream_open = status != 0;
+            }
+        }
+        return output.pos;
+    }
+#endif
+};
+
+/* the part of the witness file that is read but not parsed yet */
+class WitnessInput {
+public:
+    explicit WitnessInput(FILE *file) : reader(file), buffer(witness_chunk_size) {}
+
+    char const *begin() const { return buffer.data() + first; }
+    char const *end() const { return buffer.data() + last; }
+    std::size_t size() const { return last - first; }
+    void consume(std::size_t n) { first += n; }
+
+    /* reads more of the file behind what is left, growing the buffer if what is left already fills it. returns
+     * false at the end of the file */
+    bool more() {
+        if (first > 0) {
+            memmove(buffer.data(), buffer.data() + first, last - first);
+            last -= first;
+            first = 0;
+        }
+        if (last == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        std::size_t got = reader.read(buffer.data() + last, buffer.size() - last);
+        last += got;
+        return got > 0;
+    }
+
+    /* nullptr or why the file could not be read to its end */
+    char const *failure() const { return reader.failure(); }
+
+private:
+    WitnessReader reader;
+    std::vector<char> buffer;
+    std::size_t first = 0;
+    std::size_t last = 0;
+};
+
+bool isXmlSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void appendUtf8(std::string& out, unsigned long code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
     }
-    auto doc = std::make_shared<pugi::xml_document>();
-    pugi::xml_node root;
+}
 
-    pugi::xml_parse_result parseResult = doc->load_file(filename.c_str());
+/* replaces the predefined entities and character references, unknown ones are kept as they are. line ends become
+ * '\n', in attribute values they and tabs become ' ' - the same as pugixml's default parse options */
+void decodeXml(char const *p, char const *end, bool attribute, std::string& out) {
+    out.clear();
+    out.reserve(end - p);
+    while (p != end) {
+        char const *run = p;
+        while (p != end && *p != '&' && *p != '\r' && !(attribute && (*p == '\n' || *p == '\t'))) {
+            ++p;
+        }
+        out.append(run, p);
+        if (p == end) {
+            break;
+        }
 
-    if (!parseResult) {
-        std::cerr << "Failed to parse witness file. Reason: " << parseResult.description() << std::endl;
+        char c = *p++;
+        if (c == '\r') {
+            out += attribute ? ' ' : '\n';
+            if (p != end && *p == '\n') {
+                ++p;
+            }
+        } else if (c != '&') {
+            out += ' ';
+        } else {
+            char const *semicolon = static_cast<char const *>(memchr(p, ';', std::min<std::size_t>(end - p, 12)));
+            std::string entity = semicolon == nullptr ? std::string() : std::string(p, semicolon);
+            if (entity == "lt") {
+                out += '<';
+            } else if (entity == "gt") {
+                out += '>';
+            } else if (entity == "amp") {
+                out += '&';
+            } else if (entity == "quot") {
+                out += '"';
+            } else if (entity == "apos") {
+                out += '\'';
+            } else if (entity.size() > 1 && entity[0] == '#') {
+                bool hex = entity[1] == 'x';
+                char const *digits = entity.c_str() + (hex ? 2 : 1);
+                char *digits_end = nullptr;
+                unsigned long code = strtoul(digits, &digits_end, hex ? 16 : 10);
+                if (!isxdigit(static_cast<unsigned char>(*digits)) || *digits_end != '\0') {
+                    out += c;
+                    continue;
+                }
+                appendUtf8(out, code);
+            } else {
+                out += c;
+                continue;
+            }
+            p = semicolon + 1;
+        }
+    }
+}
+
+/* CDATA has no entities, only its line ends become '\n' */
+void copyCdata(char const *p, char const *end, std::string& out) {
+    out.clear();
+    out.reserve(end - p);
+    while (p != end) {
+        char c = *p++;
+        if (c == '\r') {
+            out += '\n';
+            if (p != end && *p == '\n') {
+                ++p;
+            }
+        } else {
+            out += c;
+        }
+    }
+}
+
+/* a single pass over the markup of the witness, reporting the elements to the handler as they end */
+class GraphmlScanner {
+public:
+    GraphmlScanner(FILE *file, GraphmlHandler& handler) : input(file), handler(handler) {}
+
+    /* returns nullptr or why the witness could not be parsed */
+    char const *scan() {
+        if (input.more() && input.size() >= 3 && memcmp(input.begin(), "\xEF\xBB\xBF", 3) == 0) {
+            input.consume(3);
+        }
+
+        while (input.size() > 0 || input.more()) {
+            char const *open = static_cast<char const *>(memchr(input.begin(), '<', input.size()));
+            char const *text_end = open == nullptr ? input.end() : open;
+            if (!open_elements.empty() && !has_text.back()) {
+                raw_text.append(input.begin(), text_end);
+            }
+            input.consume(text_end - input.begin());
+            if (open == nullptr) {
+                continue;
+            }
+
+            flushText();
+            char const *error = markup();
+            if (error != nullptr) {
+                return error;
+            }
+            if (stopped) {
+                return nullptr;
+            }
+        }
+
+        if (!open_elements.empty()) {
+            return "Start-end tags mismatch";
+        }
+        if (!root_seen) {
+            return "No document element found";
+        }
         return nullptr;
     }
 
-    root = doc->root();
+    bool wasStopped() const { return stopped; }
+
+    char const *readFailure() const { return input.failure(); }
+
+private:
+    WitnessInput input;
+    GraphmlHandler& handler;
+    std::vector<std::string> open_elements;
+    std::vector<std::string> texts;             /* the first text run of each open element */
+    std::vector<bool> has_text;
+    std::string raw_text;                       /* read since the last markup */
+    std::vector<std::string> attribute_storage;
+    GraphmlHandler::Attributes attributes;
+    bool root_seen = false;
+    bool stopped = false;
+
+    /* pugixml drops text made of whitespace only, CDATA sections always count */
+    void flushText() {
+        if (raw_text.empty()) {
+            return;
+        }
+        bool whitespace_only = true;
+        for (char c: raw_text) {
+            if (!isXmlSpace(c)) {
+                whitespace_only = false;
+                break;
+            }
+        }
+        if (!whitespace_only) {
+            decodeXml(raw_text.data(), raw_text.data() + raw_text.size(), false, texts.back());
+            has_text.back() = true;
+        }
+        raw_text.clear();
+    }
+
+    /* the length of the markup at the start of the input up to and including the terminator, or 0 if the input
+     * doesn't hold all of it yet */
+    std::size_t markupLength(char const *opening, char const *terminator) const {
+        std::size_t skip = strlen(opening);
+        std::size_t terminator_length = strlen(terminator);
+        for (char const *p = input.begin() + skip; p + terminator_length <= input.end(); ++p) {
+            p = static_cast<char const *>(memchr(p, terminator[0], input.end() - p));
+            if (p == nullptr || p + terminator_length > input.end()) {
+                return 0;
+            }
+            if (memcmp(p, terminator, terminator_length) == 0) {
+                return p + terminator_length - input.begin();
+            }
+        }
+        return 0;
+    }
+
+    /* the length of a tag up to and including its '>', which may also appear in quoted attribute values and, for
+     * a DOCTYPE, in its internal subset */
+    std::size_t tagLength() const {
+        char quote = '\0';
+        int brackets = 0;
+        for (char const *p = input.begin() + 1; p != input.end(); ++p) {
+            if (quote != '\0') {
+                if (*p == quote) {
+                    quote = '\0';
+                }
+            } else if (*p == '"' || *p == '\'') {
+                quote = *p;
+            } else if (*p == '[') {
+                ++brackets;
+            } else if (*p == ']') {
+                --brackets;
+            } else if (*p == '>' && brackets <= 0) {
+                return p + 1 - input.begin();
+            }
+        }
+        return 0;
+    }
+
+    bool startsWith(char const *opening) {
+        std::size_t length = strlen(opening);
+        while (input.size() < length && input.more()) {}
+        return input.size() >= length && memcmp(input.begin(), opening, length) == 0;
+    }
+
+    char const *markup() {
+        char const *opening = "<";
+        char const *terminator = nullptr;
+        if (startsWith("<!--")) {
+            opening = "<!--";
+            terminator = "-->";
+        } else if (startsWith("<![CDATA[")) {
+            opening = "<![CDATA[";
+            terminator = "]]>";
+        } else if (startsWith("<?")) {
+            opening = "<?";
+            terminator = "?>";
+        }
+
+        std::size_t length;
+        while ((length = terminator == nullptr ? tagLength() : markupLength(opening, terminator)) == 0) {
+            if (!input.more()) {
+                return "Unexpected end of file";
+            }
+        }
+
+        char const *begin = input.begin();
+        char const *error = nullptr;
+        if (strcmp(opening, "<![CDATA[") == 0) {
+            if (!open_elements.empty() && !has_text.back()) {
+                copyCdata(begin + 9, begin + length - 3, texts.back());
+                has_text.back() = true;
+            }
+        } else if (terminator == nullptr && begin[1] == '/') {
+            error = endTag(begin + 2, begin + length - 1);
+        } else if (terminator == nullptr && begin[1] != '!') {
+            error = startTag(begin + 1, begin + length - 1);
+        }
+        input.consume(length);
+        return error;
+    }
 
-    if (!root || !root.first_child()) {
-        std::cerr << "Witness file is empty." << std::endl;
+    char const *startTag(char const *p, char const *end) {
+        bool empty_element = end > p && end[-1] == '/';
+        if (empty_element) {
+            --end;
+        }
+
+        char const *name_end = p;
+        while (name_end != end && !isXmlSpace(*name_end)) {
+            ++name_end;
+        }
+        if (name_end == p) {
+            return "Error parsing start element tag";
+        }
+        std::string name(p, name_end);
+
+        attribute_storage.clear();
+        for (p = name_end;;) {
+            while (p != end && isXmlSpace(*p)) {
+                ++p;
+            }
+            if (p == end) {
+                break;
+            }
+            char const *attribute_name = p;
+            while (p != end && *p != '=' && !isXmlSpace(*p)) {
+                ++p;
+            }
+            attribute_storage.emplace_back(attribute_name, p);
+            while (p != end && isXmlSpace(*p)) {
+                ++p;
+            }
+            if (p == end || *p != '=') {
+                return "Error parsing attribute";
+            }
+            ++p;
+            while (p != end && isXmlSpace(*p)) {
+                ++p;
+            }
+            if (p == end || (*p != '"' && *p != '\'')) {
+                return "Error parsing attribute";
+            }
+            char const *value_end = static_cast<char const *>(memchr(p + 1, *p, end - p - 1));
+            if (value_end == nullptr) {
+                return "Error parsing attribute";
+            }
+            attribute_storage.emplace_back();
+            decodeXml(p + 1, value_end, true, attribute_storage.back());
+            p = value_end + 1;
+        }
+
+        attributes.clear();
+        for (std::size_t i = 0; i < attribute_storage.size(); i += 2) {
+            attributes.emplace_back(attribute_storage[i].c_str(), attribute_storage[i + 1].c_str());
+        }
+
+        if (open_elements.empty()) {
+            if (name != "graphml") {
+                std::cerr << "Witness isn't a GraphML document. Root element=" << name << std::endl;
+                stopped = true;
+                return nullptr;
+            }
+            root_seen = true;
+        }
+
+        open_elements.push_back(name);
+        texts.emplace_back();
+        has_text.push_back(false);
+        handler.startElement(open_elements.size(), name.c_str(), attributes);
+        if (empty_element) {
+            closeElement();
+        }
         return nullptr;
     }
 
-    if (strcmp(root.first_child().name(), "graphml") != 0) {
-        std::cerr << "Witness isn't a GraphML document. Root element=" << root.name() << std::endl;
+    char const *endTag(char const *p, char const *end) {
+        while (end != p && isXmlSpace(end[-1])) {
+            --end;
+        }
+        if (open_elements.empty() || open_elements.back().compare(0, std::string::npos, p, end - p) != 0) {
+            return "Start-end tags mismatch";
+        }
+        closeElement();
         return nullptr;
     }
-    return doc;
+
+    void closeElement() {
+        handler.endElement(open_elements.size(), open_elements.back().c_str(), texts.back());
+        open_elements.pop_back();
+        texts.pop_back();
+        has_text.pop_back();
+    }
+};
+
+}
+
+bool parseGraphmlWitness(std::string const& filename, GraphmlHandler& handler) {
+    if (filename.empty()) {
+        std::cerr << "No witness file name provided." << std::endl;
+        return false;
+    }
+
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+        std::cerr << "Failed to parse witness file. Reason: File was not found" << std::endl;
+        return false;
+    }
+
+    GraphmlScanner scanner(file, handler);
+    char const *error = scanner.scan();
+    // the markup of a file that could not be read to its end is broken as well, but the reason is the file
+    if (scanner.readFailure() != nullptr) {
+        error = scanner.readFailure();
+    }
+    fclose(file);
+
+    if (error != nullptr) {
+        std::cerr << "Failed to parse witness file. Reason: " << error << std::endl;
+        return false;
+    }
+    return !scanner.wasStopped();
 }
@@ -6,11 +6,27 @@
 #define NITWIT_WITNESS_HPP
 
 #include <string>
-#include "../utils/pugixml/pugixml.hpp"
 #include <cstring>
-#include <memory>
+#include <utility>
+#include <vector>
 
-std::shared_ptr<pugi::xml_document> parseGraphmlWitness(std::string const& filename);
+/* receives the elements of a GraphML witness while it is read, in document order */
+class GraphmlHandler {
+public:
+	typedef std::vector<std::pair<char const*, char const*>> Attributes;
+
+	virtual ~GraphmlHandler() = default;
+
+	/* the names and values are only valid during the call. depth is 1 for the root element */
+	virtual void startElement(std::size_t depth, char const* name, Attributes const& attributes) = 0;
+
+	/* text is the element's first run of text, like pugixml's xml_node::text() would return it */
+	virtual void endElement(std::size_t depth, char const* name, std::string const& text) = 0;
+};
+
+/* reads the witness in a single pass without keeping the document, handing each element to the handler. returns
+ * false if the file can't be read, isn't well formed or isn't a GraphML document */
+bool parseGraphmlWitness(std::string const& filename, GraphmlHandler& handler);
 
 
 #endif //NITWIT_WITNESS_HPP